@@ -6,6 +6,10 @@
 #include <sstream>
 #include <string>
 #include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 using namespace std;
 
@@ -33,6 +37,68 @@ const float GRAY[3] = {0.5f, 0.5f, 0.5f};
 const float BLACK[3] = {0.1f, 0.1f, 0.1f};
 const float SILVER[3] = {0.7f, 0.7f, 0.7f};
 
+// Console output from the render loop. print() only queues the line; a
+// background thread writes it, so a key toggle never waits on the console.
+// At most MAX_PENDING lines wait (later ones are counted as dropped), and
+// the destructor writes whatever is still queued before the program exits.
+class ConsoleWriter {
+public:
+    static const size_t MAX_PENDING = 256;
+
+    ConsoleWriter() : writer(&ConsoleWriter::run, this) {}
+
+    ~ConsoleWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        writer.join();
+    }
+
+    void print(const std::string& line) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (pending.size() >= MAX_PENDING) {
+                dropped++;
+                return;
+            }
+            pending.push_back(line);
+        }
+        wake.notify_one();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::string> pending;
+    size_t dropped = 0;
+    bool stopping = false;
+    std::thread writer;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [this] { return stopping || !pending.empty() || dropped > 0; });
+            std::deque<std::string> lines;
+            lines.swap(pending);
+            size_t lost = dropped;
+            dropped = 0;
+            bool done = stopping;
+            lock.unlock();
+            for (const std::string& line : lines)
+                std::cout << line << '\n';
+            if (lost > 0)
+                std::cout << "(" << lost << " console lines dropped)\n";
+            std::cout.flush();
+            lock.lock();
+            if (done && pending.empty())
+                return;
+        }
+    }
+};
+ConsoleWriter console;
+
 std::string readShaderSource(const std::string& filePath) {
     std::ifstream file(filePath);
     if (!file.is_open()) {
@@ -377,7 +443,7 @@ void processInput(GLFWwindow* window) {
     if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS && !rKeyPressed) {
         craneState.boomRotating = !craneState.boomRotating;
         rKeyPressed = true;
-        std::cout << "Boom auto-rotation: " << (craneState.boomRotating ? "ON" : "OFF") << std::endl;
+        console.print(std::string("Boom auto-rotation: ") + (craneState.boomRotating ? "ON" : "OFF"));
     }
     if (glfwGetKey(window, GLFW_KEY_R) == GLFW_RELEASE) rKeyPressed = false;
     
@@ -386,7 +452,7 @@ void processInput(GLFWwindow* window) {
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS && !aKeyPressed) {
         craneState.autoMoving = !craneState.autoMoving;
         aKeyPressed = true;
-        std::cout << "Auto-movement: " << (craneState.autoMoving ? "ON" : "OFF") << std::endl;
+        console.print(std::string("Auto-movement: ") + (craneState.autoMoving ? "ON" : "OFF"));
     }
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_RELEASE) aKeyPressed = false;
 }
@@ -0,0 +1,6 @@
+﻿#version 330 core
+// Fragment stage of the depth pre-pass: colour writes are masked, so it
+// only has to exist for the depth test and write to run
+
+void main() {
+}
@@ -1,9 +1,39 @@
 ﻿#version 330 core
 out vec4 FragColor;
+#if defined(VERTEX_COLOR) || defined(INSTANCED)
+in vec3 vertexColor;
+#else
 uniform vec3 ourColor;
-uniform bool lightOn;
+#endif
+#ifdef CLUSTERED_LIGHTS
+in vec3 viewPosition;
+in vec3 viewNormal;
+#include "../../practise1/clustered_lights.glsl"
+#endif
 
 void main() {
-    float ambient = lightOn ? 1.0 : 0.2;
-    FragColor = vec4(ourColor * ambient, 1.0);
+#ifdef OVERDRAW
+    // one step of the heat ramp per fragment, summed by additive blending
+    FragColor = vec4(0.12, 0.06, 0.03, 1.0);
+#else
+#if defined(VERTEX_COLOR) || defined(INSTANCED)
+    vec3 base = vertexColor;
+#else
+    vec3 base = ourColor;
+#endif
+#ifdef CLUSTERED_LIGHTS
+    // thin panels are seen from both sides: light the side facing the eye
+    vec3 normal = normalize(viewNormal);
+    if (dot(normal, viewPosition) > 0.0)
+        normal = -normal;
+    FragColor = vec4(base * clusteredLight(viewPosition, normal), 1.0);
+#else
+#ifdef LIGHT_ON
+    const float ambient = 1.0;
+#else
+    const float ambient = 0.2;
+#endif
+    FragColor = vec4(base * ambient, 1.0);
+#endif
+#endif
 }
\ No newline at end of file
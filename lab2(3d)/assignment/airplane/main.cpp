@@ -8,6 +8,31 @@
 #include <sstream>
 #include <vector>
 #include <cmath>
+#include <chrono>
+#include <cstring>
+#include <climits>
+#include <cstdlib>
+#include <unordered_map>
+#include <thread>
+
+#include "../../practise1/gl_extensions.h"
+#include "../../practise1/program_cache.h"
+#include "../../practise1/geometry_pool.h"
+#include "../../practise1/frame_pacer.h"
+#include "../../practise1/async_logger.h"
+#include "../../practise1/instance_buffer.h"
+#include "../../practise1/multi_draw.h"
+#include "../../practise1/mesh_optimizer.h"
+#include "../../practise1/lod.h"
+#include "../../practise1/bvh.h"
+#include "../../practise1/occlusion_buffer.h"
+#include "../../practise1/pvs.h"
+#include "../../practise1/render_queue.h"
+#include "../../practise1/camera_buffer.h"
+#include "../../practise1/job_system.h"
+#include "../../practise1/transform_batch.h"
+#include "../../practise1/scene_file.h"
+#include "../../practise1/clustered_lights.h"
 using namespace std;
 
 const unsigned int WIDTH = 1200;
@@ -26,14 +51,286 @@ bool showCockpit = false;  // New: cockpit view
 float doorAngle = 0.0f;
 float wheelRotation = 0.0f;  // New: wheel rotation angle
 
-unsigned int shader;
-unsigned int cubeVAO, cubeVBO;
-unsigned int cylinderVAO, cylinderVBO;
-unsigned int coneVAO, coneVBO;
-unsigned int diskVAO, diskVBO;
-int cylinderVertexCount = 0;
-int coneVertexCount = 0;
-int diskVertexCount = 0; 
+// All primitives share one vertex/index buffer pair and one VAO
+GeometryPool geometry;
+
+// Vertex normals sit at the first location after the instance attributes
+const GLuint NORMAL_LOCATION = 7;
+
+// A primitive's vertices (xyz, normal) and indices stay on the CPU next to
+// its slot in the pool, for baking. instances is this frame's bucket of
+// {model, colour} records, handed to the render queue by queueInstances().
+struct Primitive {
+	std::vector<float> vertices;
+	std::vector<unsigned int> indices;
+	Mesh mesh;
+	std::vector<ColoredInstance> instances;
+};
+Primitive cubeShape, diskShape;
+InstanceBuffer primitiveInstances;
+
+// Cylinders and cones exist at several tessellations; each draw picks one
+// from its projected radius (see queueRound)
+const int LOD_COUNT = 4;
+const int LOD_SEGMENTS[LOD_COUNT] = {8, 16, 32, 64};
+const int LOD_BASELINE = 2;			// the 32 segments every round part used to have
+const float LOD_ERROR_PIXELS = 1.0f;	// allowed gap between a facet and the true circle
+// size of the default framebuffer in pixels, read every frame; on HiDPI
+// screens and after a resize it differs from WIDTH x HEIGHT
+int framebufferWidth = WIDTH;
+int framebufferHeight = HEIGHT;
+Primitive cylinderLods[LOD_COUNT], coneLods[LOD_COUNT];
+float lodThresholds[LOD_COUNT - 1];
+
+// What the current frame submitted; the camera path sums it per leg
+struct FrameCounters {
+	size_t triangles = 0;
+	size_t roundTriangles = 0;			// cylinders and cones
+	size_t baselineRoundTriangles = 0;	// the same draws at LOD_BASELINE
+	size_t levelDraws[LOD_COUNT] = {};
+	int visibleParts = 0;
+	int culledParts = 0;
+	int nodesTested = 0;
+	int occludedParts = 0;		// passed the frustum, hidden behind an occluder
+	int occludedDraws = 0;		// live primitives hidden behind an occluder
+	int pvsCulledParts = 0;		// passed the frustum, in no cell the camera's cell sees
+	size_t shadedFragments = 0;	// --overdraw: colour-pass fragments that passed the depth test
+	size_t coveredPixels = 0;
+	size_t screenPixels = 0;
+	int drawCalls = 0;
+};
+FrameCounters frameCounters;
+
+void addCounters(FrameCounters& sum, const FrameCounters& add) {
+	sum.triangles += add.triangles;
+	sum.roundTriangles += add.roundTriangles;
+	sum.baselineRoundTriangles += add.baselineRoundTriangles;
+	for (int i = 0; i < LOD_COUNT; i++)
+		sum.levelDraws[i] += add.levelDraws[i];
+	sum.visibleParts += add.visibleParts;
+	sum.culledParts += add.culledParts;
+	sum.nodesTested += add.nodesTested;
+	sum.occludedParts += add.occludedParts;
+	sum.occludedDraws += add.occludedDraws;
+	sum.pvsCulledParts += add.pvsCulledParts;
+	sum.shadedFragments += add.shadedFragments;
+	sum.coveredPixels += add.coveredPixels;
+	sum.screenPixels += add.screenPixels;
+	sum.drawCalls += add.drawCalls;
+}
+
+// What one subassembly recorded this frame: a draw command per primitive
+// and its counters, plus the LOD state of its round parts, which lives
+// across frames. Every draw function records into its own list, so the
+// lists can be filled on several threads and are merged on the GL thread
+// in a fixed order, giving the same frame whatever the thread count.
+// --threads N sets the count, --job-bench times 1 to 16 threads and exits.
+struct DrawCommand {
+	Primitive* primitive;
+	ColoredInstance instance;
+};
+
+// One aircraft on the apron of --airport: its stand and its own door and
+// wheel state
+struct Aircraft {
+	glm::mat4 placement;
+	float doorAngle;
+	float wheelRotation;	// added to the global wheelRotation
+	AABB bounds;			// world space
+};
+
+struct DrawList {
+	std::vector<DrawCommand> commands;
+	FrameCounters counters;
+	MaskedOcclusionBuffer::Stats occlusionStats;
+	LodSelector lods;
+	const Aircraft* aircraft = nullptr;	// the apron aircraft this list records, if any
+};
+DrawList staticList;				// the baked batch's round parts, one LOD slot each
+thread_local DrawList* recording = nullptr;	// where the draw helpers on this thread record
+
+// The door angle, wheel rotation and model matrices the draw functions
+// use: the aircraft's own when one of the apron is being recorded
+float currentDoorAngle() {
+	return recording && recording->aircraft ? recording->aircraft->doorAngle : doorAngle;
+}
+
+float currentWheelRotation() {
+	return recording && recording->aircraft ? wheelRotation + recording->aircraft->wheelRotation : wheelRotation;
+}
+
+glm::mat4 placed(const glm::mat4& model) {
+	return recording->aircraft ? recording->aircraft->placement * model : model;
+}
+
+// Culling units. A primitive belongs to the part of its group whose bin
+// along the group's axis holds the primitive's centre, which gives
+// fuselage sections, wing panels, engines, gear legs and seat rows.
+// Primitives longer than two bins (floor panels, the ground) share one
+// extra part per group instead of stretching a bin over everything.
+enum PartGroup { PART_GROUND, PART_FUSELAGE, PART_DOOR, PART_WINGS, PART_TAIL, PART_ENGINES, PART_FANS, PART_GEAR, PART_CABIN, PART_COCKPIT };
+struct PartGroupInfo {
+	int axis;
+	float cell;
+};
+const PartGroupInfo PART_GROUPS[] = {
+	{0, 20.0f},		// ground: runway stretches
+	{0, 2.2f},		// fuselage: sections of four barrel segments
+	{0, 10.0f},		// door: one part, it swings
+	{2, 2.0f},		// wings: panels along the span
+	{2, 1.0f},		// tail: stabiliser halves and the fin
+	{2, 3.0f},		// engines: one per side
+	{2, 3.0f},		// fans: the blades inside each intake
+	{2, 1.8f},		// gear: nose leg and the two main legs
+	{0, 0.45f},		// cabin: seat rows
+	{2, 0.3f},		// cockpit: captain, pedestal, first officer
+};
+const int PART_GROUP_COUNT = sizeof(PART_GROUPS) / sizeof(PartGroupInfo);
+const int SPAN_BIN = INT_MIN;
+
+struct Part {
+	PartGroup group;
+	int bin;
+	AABB bounds;
+};
+std::vector<Part> parts;
+std::unordered_map<long long, int> partIndex;	// by partKey()
+std::vector<unsigned char> partVisible;	// this frame's cull result, by part id
+
+// Each view mode culls its own tree, so the counts only cover what it draws
+enum Scene { SCENE_EXTERIOR, SCENE_CABIN, SCENE_COCKPIT, SCENE_COUNT };
+struct PartScene {
+	std::vector<int> parts;
+	BVH tree;
+};
+PartScene partScenes[SCENE_COUNT];
+std::vector<unsigned char> sceneVisible;
+bool cullingEnabled = true;
+
+// Boxes lying inside solid geometry (the fuselage barrel, nacelles, galley
+// and lavatory blocks, cockpit panels), rasterised every frame into a
+// small CPU depth buffer that the surviving parts and live primitives are
+// tested against. --no-occlusion turns it off.
+struct Occluder {
+	Scene scene;
+	AABB box;
+};
+std::vector<Occluder> occluders;
+MaskedOcclusionBuffer occlusion;
+bool occlusionEnabled = true;
+
+// Potentially visible set of each interior scene. The fuselage is cut
+// along X into cells (lavatory, aft galley, one per seat row, front
+// galley, cockpit) and which cells see which is worked out once at
+// startup, against the solid blocks that scene draws itself; a part is
+// drawn only if one of the cells it overlaps is seen from the camera's
+// cell. It only narrows the scene of the current view: the cabin and
+// cockpit modes still draw just their own parts, which is all that is
+// left with --no-pvs or a camera outside every cell. A scene whose cells
+// all see each other is not tested per frame.
+PotentiallyVisibleSet scenePvs[SCENE_COUNT];
+bool pvsCulls[SCENE_COUNT] = {};	// some cell of the scene cannot see another
+std::vector<uint64_t> partCells;	// cells each part overlaps, all bits for parts outside the cells
+bool pvsEnabled = true;
+
+// While surveying, the draw helpers only grow the bounds of their parts
+bool surveying = false;
+Scene surveyScene = SCENE_EXTERIOR;
+thread_local PartGroup currentGroup = PART_GROUND;
+
+// Optional GL 4.3 submission (--multi-draw): every queued primitive becomes
+// one indirect command and the lot goes out in a single call
+MultiDrawBuffer multiDraw;
+
+// Every draw of the frame, keyed by program, VAO, material and depth and
+// replayed in key order (see replayQueue). Colour is per instance, so the
+// material is the primitive type: the one thing that ends an instanced
+// run. Inside a run draws go nearest first, so the depth test rejects the
+// hidden layers of the cockpit panels before they are shaded; --no-sort
+// leaves the depth out of the key.
+enum QueueProgram { PROGRAM_BATCH, PROGRAM_INSTANCED, PROGRAM_MULTI_DRAW, PROGRAM_FLEET, PROGRAM_COUNT };
+enum QueueVao { VAO_BAKED, VAO_PRIMITIVES };
+RenderQueue renderQueue;
+bool depthSortEnabled = true;
+std::vector<const Mesh*> runMeshes;
+
+// --depth-prepass draws the frame once with depth-only programs (see
+// depth.fs), then shades it with GL_EQUAL so each pixel is shaded once. --overdraw counts the
+// shaded fragments per pixel in the stencil buffer and shows them as an
+// additive heat map.
+bool depthPrepass = false;
+bool overdrawView = false;
+std::vector<unsigned char> stencilPixels;
+
+// CPU cost of queueing and submitting the instances, reported every few seconds
+struct SubmitStats {
+	int frames = 0;
+	size_t draws = 0;
+	int calls = 0;
+	int prepassCalls = 0;		// --depth-prepass: calls of the depth-only pass, not in calls
+	double cpuMs = 0.0;
+	double recordMs = 0.0;		// recording the draw lists, all threads together
+	double reportTime = 0.0;
+	size_t visibleParts = 0;
+	size_t culledParts = 0;
+	size_t occludedParts = 0;
+	size_t occludedDraws = 0;
+	size_t pvsCulledParts = 0;
+	size_t shadedFragments = 0;
+	size_t coveredPixels = 0;
+	size_t screenPixels = 0;
+	int runs = 0;
+	int programChanges = 0;
+	int vaoChanges = 0;
+	size_t lights = 0;
+	size_t visibleLights = 0;
+	size_t lightReferences = 0;
+	size_t occupiedClusters = 0;
+	int maxClusterLights = 0;
+	double clusterMs = 0.0;
+};
+SubmitStats submitStats;
+
+// A cylinder or cone draw kept as is so its LOD can change per frame
+struct RoundDraw {
+	Primitive* levels;
+	glm::mat4 model;
+	glm::vec3 color;
+	int part;
+};
+
+// The merged geometry of one part: world space, per-vertex colour and
+// normal (xyz rgb normal)
+const size_t BAKED_FLOATS = 9;
+struct BatchChunk {
+	std::vector<float> vertices;
+	std::vector<unsigned int> indices;
+	Mesh mesh;
+};
+
+// Static geometry merged per part into its own pool; the chunks of the
+// visible parts go out in one multi-draw. Round parts are not merged: they
+// are listed in roundDraws and queued every frame at their current LOD.
+struct StaticBatch {
+	std::vector<BatchChunk> chunks;	// by part id
+	int primitives = 0;
+	std::vector<RoundDraw> roundDraws;
+};
+GeometryPool bakedGeometry;
+StaticBatch exteriorBatch;
+
+// While set, drawCube/drawCylinder/drawCone append to this batch instead of drawing
+StaticBatch* captureBatch = nullptr;
+
+// --scene loads the culling parts and the static exterior from a scene
+// file instead of running the draw functions; --export-scene writes the
+// ones built from code. While sceneExport is set, every captured
+// primitive is also recorded there. sceneFile stays mapped from the part
+// table to the exterior upload.
+const char* sceneFilePath = nullptr;
+const char* exportScenePath = nullptr;
+SceneWriter* sceneExport = nullptr;
+MappedSceneFile sceneFile;
 
 void printControls() {
 	std:: cout << " Hello  world" << endl;
@@ -52,93 +349,117 @@ void printControls() {
 	std::cout << "====================================================" << std::endl;
 }
 
-std::string loadShader(const char* path) {
-	std::ifstream file(path, std::ios::binary);
-	std::stringstream ss;
-	if (file.is_open()) {
-		ss << file.rdbuf();
-		std::string content = ss.str();
-		if (content.size() >= 3 && (unsigned char)content[0] == 0xEF) content.erase(0, 3);
-		return content;
-	}
-	return "";
+// Gives a primitive its normals, reorders it for the post-transform cache
+// and for vertex fetch, then adds it to the pool. The ACMR (vertex shader
+// runs per triangle) is logged against the 3.0 of the old triangle soup.
+void uploadPrimitive(Primitive& primitive, const char* name) {
+	generateNormals(primitive.vertices, primitive.indices);
+	size_t vertexCount = primitive.vertices.size() / 6;
+	float indexedAcmr = computeACMR(primitive.indices.data(), primitive.indices.size(), vertexCount);
+	optimizeVertexCache(primitive.indices.data(), primitive.indices.size(), vertexCount);
+	vertexCount = optimizeVertexFetch(primitive.vertices, 6, primitive.indices);
+	float optimizedAcmr = computeACMR(primitive.indices.data(), primitive.indices.size(), vertexCount);
+
+	logger().log("%s: %zu vertices for %zu triangles, ACMR 3.00 soup / %.2f indexed / %.2f optimised",
+		name, vertexCount, primitive.indices.size() / 3, indexedAcmr, optimizedAcmr);
+	primitive.mesh = geometry.add(primitive.vertices.data(), vertexCount, primitive.indices.data(), primitive.indices.size());
 }
 
-// Create cylinder mesh
-void createCylinderVAO() {
-	std::vector<float> vertices;
-	int segments = 32;
+void createCubeMesh() {
+	cubeShape.vertices = {
+		-0.5f, -0.5f, -0.5f,  0.5f, -0.5f, -0.5f,  0.5f, 0.5f, -0.5f,  -0.5f, 0.5f, -0.5f,
+		-0.5f, -0.5f,  0.5f,  0.5f, -0.5f,  0.5f,  0.5f, 0.5f,  0.5f,  -0.5f, 0.5f,  0.5f
+	};
+	cubeShape.indices = {
+		0, 1, 2, 2, 3, 0,	// back
+		4, 5, 6, 6, 7, 4,	// front
+		7, 3, 0, 0, 4, 7,	// left
+		6, 2, 1, 1, 5, 6,	// right
+		0, 1, 5, 5, 4, 0,	// bottom
+		3, 2, 6, 6, 7, 3	// top
+	};
+	uploadPrimitive(cubeShape, "cube");
+}
+
+// Unit cylinder along Y: cap centres first, then a bottom/top vertex pair
+// per segment shared by the side quads and the caps
+void createCylinderMesh(Primitive& shape, int segments) {
+	std::vector<float>& vertices = shape.vertices;
+	std::vector<unsigned int>& indices = shape.indices;
 	
+	vertices = {0, 0.5f, 0, 0, -0.5f, 0};
 	for (int i = 0; i < segments; i++) {
-		float theta1 = (float)i / segments * 2.0f * PI;
-		float theta2 = (float)(i + 1) / segments * 2.0f * PI;
-		
-		float x1 = cos(theta1), z1 = sin(theta1);
-		float x2 = cos(theta2), z2 = sin(theta2);
-		
-		vertices.insert(vertices.end(), {x1, -0.5f, z1, x1, 0.5f, z1, x2, 0.5f, z2});
-		vertices.insert(vertices.end(), {x1, -0.5f, z1, x2, 0.5f, z2, x2, -0.5f, z2});
-		vertices.insert(vertices.end(), {0, 0.5f, 0, x1, 0.5f, z1, x2, 0.5f, z2});
-		vertices.insert(vertices.end(), {0, -0.5f, 0, x2, -0.5f, z2, x1, -0.5f, z1});
+		float theta = (float)i / segments * 2.0f * PI;
+		float x = cos(theta), z = sin(theta);
+		vertices.insert(vertices.end(), {x, -0.5f, z, x, 0.5f, z});
 	}
 	
-	cylinderVertexCount = (int)vertices.size() / 3;
+	const unsigned int topCentre = 0, bottomCentre = 1;
+	for (int i = 0; i < segments; i++) {
+		unsigned int b1 = 2 + 2 * i, t1 = b1 + 1;
+		unsigned int b2 = 2 + 2 * ((i + 1) % segments), t2 = b2 + 1;
+		indices.insert(indices.end(), {b1, t1, t2, b1, t2, b2});
+		indices.insert(indices.end(), {topCentre, t1, t2});
+		indices.insert(indices.end(), {bottomCentre, b2, b1});
+	}
 	
-	glGenVertexArrays(1, &cylinderVAO);
-	glGenBuffers(1, &cylinderVBO);
-	glBindVertexArray(cylinderVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, cylinderVBO);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
+	char name[32];
+	snprintf(name, sizeof(name), "cylinder/%d", segments);
+	uploadPrimitive(shape, name);
 }
 
-void createConeVAO() {
-	std::vector<float> vertices;
-	int segments = 32;
+// Apex at the top, then the base centre and one ring vertex per segment
+void createConeMesh(Primitive& shape, int segments) {
+	std::vector<float>& vertices = shape.vertices;
+	std::vector<unsigned int>& indices = shape.indices;
 	
+	vertices = {0, 0.5f, 0, 0, -0.5f, 0};
 	for (int i = 0; i < segments; i++) {
-		float theta1 = (float)i / segments * 2.0f * PI;
-		float theta2 = (float)(i + 1) / segments * 2.0f * PI;
-		
-		float x1 = cos(theta1), z1 = sin(theta1);
-		float x2 = cos(theta2), z2 = sin(theta2);
-		
-		vertices.insert(vertices.end(), {0, 0.5f, 0, x1, -0.5f, z1, x2, -0.5f, z2});
-		vertices.insert(vertices.end(), {0, -0.5f, 0, x2, -0.5f, z2, x1, -0.5f, z1});
+		float theta = (float)i / segments * 2.0f * PI;
+		vertices.insert(vertices.end(), {cos(theta), -0.5f, sin(theta)});
 	}
 	
-	coneVertexCount = (int)vertices.size() / 3;
+	const unsigned int apex = 0, baseCentre = 1;
+	for (int i = 0; i < segments; i++) {
+		unsigned int r1 = 2 + i, r2 = 2 + (i + 1) % segments;
+		indices.insert(indices.end(), {apex, r1, r2});
+		indices.insert(indices.end(), {baseCentre, r2, r1});
+	}
 	
-	glGenVertexArrays(1, &coneVAO);
-	glGenBuffers(1, &coneVBO);
-	glBindVertexArray(coneVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, coneVBO);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
+	char name[32];
+	snprintf(name, sizeof(name), "cone/%d", segments);
+	uploadPrimitive(shape, name);
 }
 
-void createDiskVAO() {
-	std::vector<float> vertices;
+// One mesh per LOD_SEGMENTS entry, and the screen radii at which a draw
+// needs the next finer one
+void createRoundLods() {
+	float thresholds[LOD_COUNT - 1];
+	for (int i = 0; i < LOD_COUNT; i++) {
+		createCylinderMesh(cylinderLods[i], LOD_SEGMENTS[i]);
+		createConeMesh(coneLods[i], LOD_SEGMENTS[i]);
+		if (i < LOD_COUNT - 1)
+			thresholds[i] = lodSwitchRadius(LOD_SEGMENTS[i], LOD_ERROR_PIXELS);
+	}
+	std::copy(thresholds, thresholds + LOD_COUNT - 1, lodThresholds);
+	logger().log("Round LODs %d/%d/%d/%d segments, switching at %.0f/%.0f/%.0f px radius",
+		LOD_SEGMENTS[0], LOD_SEGMENTS[1], LOD_SEGMENTS[2], LOD_SEGMENTS[3], thresholds[0], thresholds[1], thresholds[2]);
+}
+
+void createDiskMesh() {
+	std::vector<float>& vertices = diskShape.vertices;
+	std::vector<unsigned int>& indices = diskShape.indices;
 	int segments = 32;
 	
+	vertices = {0, 0, 0};
 	for (int i = 0; i < segments; i++) {
-		float theta1 = (float)i / segments * 2.0f * PI;
-		float theta2 = (float)(i + 1) / segments * 2.0f * PI;
-		
-		vertices.insert(vertices.end(), {0, 0, 0, cos(theta1), 0, sin(theta1), cos(theta2), 0, sin(theta2)});
+		float theta = (float)i / segments * 2.0f * PI;
+		vertices.insert(vertices.end(), {cos(theta), 0, sin(theta)});
 	}
 	
-	diskVertexCount = (int)vertices.size() / 3;
-	
-	glGenVertexArrays(1, &diskVAO);
-	glGenBuffers(1, &diskVBO);
-	glBindVertexArray(diskVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, diskVBO);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
+	for (int i = 0; i < segments; i++)
+		indices.insert(indices.end(), {0u, 1u + i, 1u + (i + 1) % segments});
+	uploadPrimitive(diskShape, "disk");
 }
 
 void processInput(GLFWwindow* window, float dt) {
@@ -193,34 +514,144 @@ void processInput(GLFWwindow* window, float dt) {
 	if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS) wheelRotation += 200.0f * dt;
 }
 
-void drawCube(glm::mat4 model, glm::mat4 view, glm::mat4 proj, glm::vec3 color) {
-	glUniformMatrix4fv(glGetUniformLocation(shader, "model"), 1, GL_FALSE, glm::value_ptr(model));
-	glUniformMatrix4fv(glGetUniformLocation(shader, "view"), 1, GL_FALSE, glm::value_ptr(view));
-	glUniformMatrix4fv(glGetUniformLocation(shader, "projection"), 1, GL_FALSE, glm::value_ptr(proj));
-	glUniform3fv(glGetUniformLocation(shader, "ourColor"), 1, glm::value_ptr(color));
-	glUniform1i(glGetUniformLocation(shader, "lightOn"), 1);
-	glBindVertexArray(cubeVAO);
-	glDrawArrays(GL_TRIANGLES, 0, 36);
+// World bounds of the unit cube under `model`
+AABB cubeBounds(const glm::mat4& model) {
+	AABB bounds;
+	glm::vec3 center = glm::vec3(model[3]);
+	glm::vec3 extent = 0.5f * (glm::abs(glm::vec3(model[0])) + glm::abs(glm::vec3(model[1])) + glm::abs(glm::vec3(model[2])));
+	bounds.min = center - extent;
+	bounds.max = center + extent;
+	return bounds;
+}
+
+// World bounds of a unit cylinder or cone: the ellipse its ring turns into
+// plus half the axis. Spinning a wheel about its axle leaves them unchanged.
+AABB roundBounds(const glm::mat4& model) {
+	AABB bounds;
+	glm::vec3 center = glm::vec3(model[3]);
+	glm::vec3 x = glm::vec3(model[0]), y = glm::vec3(model[1]), z = glm::vec3(model[2]);
+	glm::vec3 extent = glm::sqrt(x * x + z * z) + 0.5f * glm::abs(y);
+	bounds.min = center - extent;
+	bounds.max = center + extent;
+	return bounds;
+}
+
+long long partKey(int group, int bin) {
+	return ((long long)group << 32) | (unsigned int)bin;
+}
+
+// The part of currentGroup a primitive with these bounds belongs to; -1 if
+// the survey (or the scene file) never saw it, in which case it is never culled
+int findPart(const AABB& bounds) {
+	const PartGroupInfo& group = PART_GROUPS[currentGroup];
+	int bin = bounds.extent()[group.axis] > group.cell ? SPAN_BIN : (int)floor(bounds.center()[group.axis] / group.cell + 0.5f);
+	long long key = partKey(currentGroup, bin);
+	auto found = partIndex.find(key);
+	if (found != partIndex.end()) {
+		if (surveying)
+			parts[found->second].bounds.expand(bounds);
+		return found->second;
+	}
+	if (!surveying)
+		return -1;
+
+	int id = (int)parts.size();
+	parts.push_back({currentGroup, bin, bounds});
+	partIndex[key] = id;
+	partScenes[surveyScene].parts.push_back(id);
+	return id;
+}
+
+// Transforms a primitive into world space and appends it to its part's
+// chunk of captureBatch
+void capturePrimitive(const Primitive& primitive, const glm::mat4& model, const glm::vec3& color, int part) {
+	BatchChunk& chunk = captureBatch->chunks[part];
+	unsigned int base = (unsigned int)(chunk.vertices.size() / BAKED_FLOATS);
+	glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+	for (size_t i = 0; i < primitive.vertices.size(); i += 6) {
+		const float* v = &primitive.vertices[i];
+		glm::vec4 p = model * glm::vec4(v[0], v[1], v[2], 1.0f);
+		glm::vec3 n = glm::normalize(normalMatrix * glm::vec3(v[3], v[4], v[5]));
+		chunk.vertices.insert(chunk.vertices.end(), {p.x, p.y, p.z, color.x, color.y, color.z, n.x, n.y, n.z});
+	}
+	for (unsigned int index : primitive.indices)
+		chunk.indices.push_back(base + index);
+	captureBatch->primitives++;
+	if (sceneExport)
+		sceneExport->addRecord(SCENE_CUBE, part, glm::vec4(color, 1.0f), model);
+}
+
+// The draw helpers only queue an instance, and only for parts that
+// survived this frame's culling; view and projection are set once per
+// frame through the Camera uniform block
+// Live primitives whose part survived are tested on their own against the
+// occlusion buffer. Apron aircraft are left out: the buffer is only filled
+// for frames that cull the single aircraft's scenes.
+bool liveVisible(int part, const AABB& bounds) {
+	if (part >= 0 && !partVisible[part])
+		return false;
+	if (occlusionEnabled && !recording->aircraft && !occlusion.testBox(bounds, recording->occlusionStats)) {
+		recording->counters.occludedDraws++;
+		return false;
+	}
+	return true;
+}
+
+void drawCube(glm::mat4 model, glm::mat4 /*view*/, glm::mat4 /*proj*/, glm::vec3 color) {
+	AABB bounds = cubeBounds(model);
+	int part = findPart(bounds);
+	if (surveying)
+		return;
+	if (captureBatch) {
+		capturePrimitive(cubeShape, model, color, part);
+		return;
+	}
+	if (!liveVisible(part, bounds))
+		return;
+	recording->commands.push_back({&cubeShape, {placed(model), glm::vec4(color, 1.0f)}});
+}
+
+// Queues a cylinder or cone at the LOD its on-screen size calls for. The
+// unit meshes have their ring in XZ, so the ring radius is the longer of
+// the model's X and Z axes.
+// Baked round parts pass their index in roundDraws as LOD slot, which stays
+// theirs while culling skips others; live ones pass -1.
+void queueRound(Primitive* levels, const glm::mat4& model, const glm::vec3& color, const glm::mat4& view, const glm::mat4& proj, int slot) {
+	glm::vec3 center = glm::vec3(model[3]);
+	float radius = glm::max(glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[2])));
+	float screenRadius = projectedRadius(center, radius, view, proj, (float)framebufferHeight);
+	LodSelector& lods = recording->lods;
+	int level = slot >= 0 ? lods.select((size_t)slot, screenRadius) : lods.select(screenRadius);
+	recording->commands.push_back({&levels[level], {model, glm::vec4(color, 1.0f)}});
+
+	FrameCounters& counters = recording->counters;
+	counters.levelDraws[level]++;
+	counters.roundTriangles += levels[level].mesh.count / 3;
+	counters.baselineRoundTriangles += levels[LOD_BASELINE].mesh.count / 3;
+}
+
+void drawRound(Primitive* levels, const glm::mat4& model, const glm::mat4& view, const glm::mat4& proj, const glm::vec3& color) {
+	AABB bounds = roundBounds(model);
+	int part = findPart(bounds);
+	if (surveying)
+		return;
+	if (captureBatch) {
+		captureBatch->roundDraws.push_back({levels, model, color, part});
+		if (sceneExport)
+			sceneExport->addRecord(levels == cylinderLods ? SCENE_CYLINDER : SCENE_CONE, part, glm::vec4(color, 1.0f), model);
+		return;
+	}
+	if (!liveVisible(part, bounds))
+		return;
+	queueRound(levels, placed(model), color, view, proj, -1);
 }
 
 void drawCylinder(glm::mat4 model, glm::mat4 view, glm::mat4 proj, glm::vec3 color) {
-	glUniformMatrix4fv(glGetUniformLocation(shader, "model"), 1, GL_FALSE, glm::value_ptr(model));
-	glUniformMatrix4fv(glGetUniformLocation(shader, "view"), 1, GL_FALSE, glm::value_ptr(view));
-	glUniformMatrix4fv(glGetUniformLocation(shader, "projection"), 1, GL_FALSE, glm::value_ptr(proj));
-	glUniform3fv(glGetUniformLocation(shader, "ourColor"), 1, glm::value_ptr(color));
-	glUniform1i(glGetUniformLocation(shader, "lightOn"), 1);
-	glBindVertexArray(cylinderVAO);
-	glDrawArrays(GL_TRIANGLES, 0, cylinderVertexCount);
+	drawRound(cylinderLods, model, view, proj, color);
 }
 
 void drawCone(glm::mat4 model, glm::mat4 view, glm::mat4 proj, glm::vec3 color) {
-	glUniformMatrix4fv(glGetUniformLocation(shader, "model"), 1, GL_FALSE, glm::value_ptr(model));
-	glUniformMatrix4fv(glGetUniformLocation(shader, "view"), 1, GL_FALSE, glm::value_ptr(view));
-	glUniformMatrix4fv(glGetUniformLocation(shader, "projection"), 1, GL_FALSE, glm::value_ptr(proj));
-	glUniform3fv(glGetUniformLocation(shader, "ourColor"), 1, glm::value_ptr(color));
-	glUniform1i(glGetUniformLocation(shader, "lightOn"), 1);
-	glBindVertexArray(coneVAO);
-	glDrawArrays(GL_TRIANGLES, 0, coneVertexCount);
+	drawRound(coneLods, model, view, proj, color);
 }
 
 // CYLINDRICAL FUSELAGE - Updated colors
@@ -415,6 +846,8 @@ void drawEngines(glm::mat4 view, glm::mat4 proj) {
 		exhaust = glm::scale(exhaust, glm::vec3(0.45f, 0.15f, 0.45f));
 		drawCylinder(exhaust, view, proj, darkGrey);
 		
+		// the fan sits inside the intake and is culled on its own
+		currentGroup = PART_FANS;
 		for (int b = 0; b < 8; b++) {
 			float angle = b * 45.0f;
 			glm::mat4 blade = glm::translate(glm::mat4(1.0f), glm::vec3(2.45f, -1.0f, z));
@@ -422,76 +855,66 @@ void drawEngines(glm::mat4 view, glm::mat4 proj) {
 			drawCube(glm::scale(glm::translate(blade, glm::vec3(0, 0.15f, 0)), glm::vec3(0.04f, 0.3f, 0.06f)),
 				view, proj, glm::vec3(0.55f, 0.55f, 0.6f));
 		}
+		currentGroup = PART_ENGINES;
 	}
 }
 
-// Landing gear with ROTATING wheels
+// Landing gear struts and bogies (static)
 void drawLandingGear(glm::mat4 view, glm::mat4 proj) {
 	// NOSE GEAR
 	drawCube(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(5.5f, -0.7f, 0)), glm::vec3(0.15f, 1.3f, 0.15f)),
 		view, proj, glm::vec3(0.3f, 0.3f, 0.3f));
 	
-	for (float z : {0.22f, -0.22f}) {
-		// Tire with rotation
-		glm::mat4 wheel = glm::translate(glm::mat4(1.0f), glm::vec3(5.5f, -1.4f, z));
-		wheel = glm::rotate(wheel, glm::radians(90.0f), glm::vec3(1, 0, 0));
-		wheel = glm::rotate(wheel, glm::radians(wheelRotation), glm::vec3(0, 1, 0));  // Rotation!
-		wheel = glm::scale(wheel, glm::vec3(0.35f, 0.25f, 0.35f));
-		drawCylinder(wheel, view, proj, glm::vec3(0.1f, 0.1f, 0.1f));
-		
-		// Rim with rotation
-		wheel = glm::translate(glm::mat4(1.0f), glm::vec3(5.5f, -1.4f, z));
-		wheel = glm::rotate(wheel, glm::radians(90.0f), glm::vec3(1, 0, 0));
-		wheel = glm::rotate(wheel, glm::radians(wheelRotation), glm::vec3(0, 1, 0));
-		wheel = glm::scale(wheel, glm::vec3(0.25f, 0.26f, 0.25f));
-		drawCylinder(wheel, view, proj, glm::vec3(0.7f, 0.7f, 0.7f));
-		
-		// Hub
-		wheel = glm::translate(glm::mat4(1.0f), glm::vec3(5.5f, -1.4f, z));
-		wheel = glm::rotate(wheel, glm::radians(90.0f), glm::vec3(1, 0, 0));
-		wheel = glm::rotate(wheel, glm::radians(wheelRotation), glm::vec3(0, 1, 0));
-		wheel = glm::scale(wheel, glm::vec3(0.12f, 0.27f, 0.12f));
-		drawCylinder(wheel, view, proj, glm::vec3(0.85f, 0.85f, 0.85f));
-	}
-	
 	for (float z : {1.8f, -1.8f}) {
 		drawCube(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.5f, -0.85f, z)), glm::vec3(0.25f, 1.1f, 0.25f)),
 			view, proj, glm::vec3(0.3f, 0.3f, 0.3f));
 		
 		drawCube(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.5f, -1.45f, z)), glm::vec3(0.4f, 0.18f, 0.85f)),
 			view, proj, glm::vec3(0.35f, 0.35f, 0.35f));
-		
+	}
+}
+
+// ROTATING wheels, animated by wheelRotation. Every tire, rim and hub is
+// the same translate, rotate 90 about X, roll about Y, scale chain, so the
+// matrices are composed in one batch.
+void drawWheels(glm::mat4 view, glm::mat4 proj) {
+	static thread_local TransformArrays wheels;
+	static thread_local std::vector<glm::vec3> colors;
+	static thread_local std::vector<AffineMatrix> matrices;
+	wheels.clear();
+	colors.clear();
+	float rotation = currentWheelRotation();
+	auto addWheel = [&](glm::vec3 position, glm::vec3 scale, glm::vec3 color) {
+		wheels.add(position, glm::vec4(90.0f, rotation, 0.0f, 0.0f), scale);
+		colors.push_back(color);
+	};
+
+	// NOSE GEAR
+	for (float z : {0.22f, -0.22f}) {
+		addWheel(glm::vec3(5.5f, -1.4f, z), glm::vec3(0.35f, 0.25f, 0.35f), glm::vec3(0.1f, 0.1f, 0.1f));		// Tire
+		addWheel(glm::vec3(5.5f, -1.4f, z), glm::vec3(0.25f, 0.26f, 0.25f), glm::vec3(0.7f, 0.7f, 0.7f));		// Rim
+		addWheel(glm::vec3(5.5f, -1.4f, z), glm::vec3(0.12f, 0.27f, 0.12f), glm::vec3(0.85f, 0.85f, 0.85f));	// Hub
+	}
+	
+	for (float z : {1.8f, -1.8f}) {
 		for (int w = 0; w < 2; w++) {
 			float zOffset = z + (w == 0 ? -0.3f : 0.3f);
-			
-			// Tire with rotation
-			glm::mat4 wheel = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f, -1.5f, zOffset));
-			wheel = glm::rotate(wheel, glm::radians(90.0f), glm::vec3(1, 0, 0));
-			wheel = glm::rotate(wheel, glm::radians(wheelRotation), glm::vec3(0, 1, 0));
-			wheel = glm::scale(wheel, glm::vec3(0.45f, 0.28f, 0.45f));
-			drawCylinder(wheel, view, proj, glm::vec3(0.08f, 0.08f, 0.08f));
-			
-			// Rim with rotation
-			wheel = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f, -1.5f, zOffset));
-			wheel = glm::rotate(wheel, glm::radians(90.0f), glm::vec3(1, 0, 0));
-			wheel = glm::rotate(wheel, glm::radians(wheelRotation), glm::vec3(0, 1, 0));
-			wheel = glm::scale(wheel, glm::vec3(0.32f, 0.29f, 0.32f));
-			drawCylinder(wheel, view, proj, glm::vec3(0.7f, 0.7f, 0.7f));
-			
-			// Hub with rotation
-			wheel = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f, -1.5f, zOffset));
-			wheel = glm::rotate(wheel, glm::radians(90.0f), glm::vec3(1, 0, 0));
-			wheel = glm::rotate(wheel, glm::radians(wheelRotation), glm::vec3(0, 1, 0));
-			wheel = glm::scale(wheel, glm::vec3(0.15f, 0.3f, 0.15f));
-			drawCylinder(wheel, view, proj, glm::vec3(0.85f, 0.85f, 0.85f));
+			addWheel(glm::vec3(0.5f, -1.5f, zOffset), glm::vec3(0.45f, 0.28f, 0.45f), glm::vec3(0.08f, 0.08f, 0.08f));	// Tire
+			addWheel(glm::vec3(0.5f, -1.5f, zOffset), glm::vec3(0.32f, 0.29f, 0.32f), glm::vec3(0.7f, 0.7f, 0.7f));		// Rim
+			addWheel(glm::vec3(0.5f, -1.5f, zOffset), glm::vec3(0.15f, 0.3f, 0.15f), glm::vec3(0.85f, 0.85f, 0.85f));		// Hub
 		}
 	}
+
+	matrices.resize(wheels.size());
+	composeEulerTransforms(wheels, matrices.data());
+	for (size_t i = 0; i < matrices.size(); i++)
+		drawCylinder(matrices[i].toMat4(), view, proj, colors[i]);
 }
 
 // Door - LARGER and more visible
 void drawDoor(glm::mat4 view, glm::mat4 proj) {
 	glm::mat4 doorBase = glm::translate(glm::mat4(1.0f), glm::vec3(3.5f, -0.15f, 0.57f));
-	doorBase = glm::rotate(doorBase, glm::radians(-doorAngle), glm::vec3(0, 1, 0));
+	doorBase = glm::rotate(doorBase, glm::radians(-currentDoorAngle()), glm::vec3(0, 1, 0));
 	
 	// Door body - LARGER SIZE - distinct red-brown color for visibility
 	drawCube(glm::scale(doorBase, glm::vec3(1.0f, 1.5f, 0.12f)), view, proj, glm::vec3(0.65f, 0.25f, 0.25f));
@@ -519,18 +942,36 @@ void drawEmergencyExits(glm::mat4 view, glm::mat4 proj) {
 
 // ==================== INTERIOR ====================
 
+// Cabin layout shared by the draw functions and the cabin's lights
+const int SEAT_ROWS = 24;
+const int CEILING_LIGHTS = 28;
+const float LED_Z[2] = {0.58f, -0.58f};
+
+float seatRowX(int row) {
+	return 4.5f - row * 0.45f;
+}
+
+// Distance of a seat from the aisle centre line; 0 is the aisle seat
+float seatZ(int seat) {
+	return 0.55f + seat * 0.28f;
+}
+
+float ceilingLightX(int i) {
+	return 5.0f - i * 0.45f;
+}
+
 // Realistic cabin interior matching reference image (dark grey/black seats)
 void drawCabinSeats(glm::mat4 view, glm::mat4 proj) {
 	glm::vec3 seatColor = {0.18f, 0.18f, 0.2f};      // Dark grey
 	glm::vec3 headrestColor = {0.15f, 0.15f, 0.17f}; // Darker grey
 	glm::vec3 frameColor = {0.12f, 0.12f, 0.12f};    // Black frame
 	
-	for (int row = 0; row < 24; row++) {
-		float x = 4.5f - row * 0.45f;
+	for (int row = 0; row < SEAT_ROWS; row++) {
+		float x = seatRowX(row);
 		
 		// Left side seats (3 seats: A, B, C)
 		for (int seat = 0; seat < 3; seat++) {
-			float z = 0.55f + seat * 0.28f;
+			float z = seatZ(seat);
 			
 			// Seat cushion
 			drawCube(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(x, -0.42f, z)), glm::vec3(0.28f, 0.1f, 0.25f)),
@@ -554,7 +995,7 @@ void drawCabinSeats(glm::mat4 view, glm::mat4 proj) {
 		
 		// Right side seats (3 seats: D, E, F)
 		for (int seat = 0; seat < 3; seat++) {
-			float z = -0.55f - seat * 0.28f;
+			float z = -seatZ(seat);
 			
 			drawCube(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(x, -0.42f, z)), glm::vec3(0.28f, 0.1f, 0.25f)),
 				view, proj, seatColor);
@@ -610,13 +1051,13 @@ void drawCabinCeiling(glm::mat4 view, glm::mat4 proj) {
 	
 	glm::vec3 lightCol = lightOn ? glm::vec3(1.0f, 0.98f, 0.92f) : glm::vec3(0.3f, 0.3f, 0.32f);
 	
-	for (int i = 0; i < 28; i++) {
-		float x = 5.0f - i * 0.45f;
+	for (int i = 0; i < CEILING_LIGHTS; i++) {
+		float x = ceilingLightX(i);
 		drawCube(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(x, 1.03f, 0)), glm::vec3(0.32f, 0.015f, 0.25f)),
 			view, proj, lightCol);
 		
 		if (lightOn) {
-			for (float z : {0.58f, -0.58f}) {
+			for (float z : LED_Z) {
 				drawCube(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.99f, z)), glm::vec3(0.25f, 0.015f, 0.08f)),
 					view, proj, glm::vec3(0.5f, 0.7f, 1.0f));
 			}
@@ -624,6 +1065,57 @@ void drawCabinCeiling(glm::mat4 view, glm::mat4 proj) {
 	}
 }
 
+// The point lights of the cabin, by lightOn: a warm light under every
+// ceiling panel and a short-range blue one at every LED while the lights
+// are on, and with --reading-lights one over each seat either way
+bool readingLights = false;
+std::vector<PointLight> cabinLights[2];
+
+void createCabinLights() {
+	for (int on = 0; on < 2; on++) {
+		std::vector<PointLight>& lights = cabinLights[on];
+		for (int i = 0; on && i < CEILING_LIGHTS; i++) {
+			float x = ceilingLightX(i);
+			lights.push_back({glm::vec3(x, 0.98f, 0.0f), 2.5f, glm::vec3(1.0f, 0.95f, 0.85f)});
+			for (float z : LED_Z)
+				lights.push_back({glm::vec3(x, 0.96f, z * 0.95f), 0.8f, glm::vec3(0.25f, 0.35f, 0.5f)});
+		}
+		for (int row = 0; readingLights && row < SEAT_ROWS; row++) {
+			for (int seat = 0; seat < 3; seat++) {
+				for (float side : {1.0f, -1.0f})
+					lights.push_back({glm::vec3(seatRowX(row), 0.66f, side * seatZ(seat)), 1.0f, glm::vec3(0.6f, 0.5f, 0.35f)});
+			}
+		}
+	}
+	logger().log("Cabin lights: %zu on, %zu off", cabinLights[1].size(), cabinLights[0].size());
+}
+
+// --no-lights keeps the old flat shading; otherwise the CLUSTERED_LIGHTS
+// programs read the lights binned here every frame
+bool clusteredLighting = true;
+LightClusters lightClusters;
+LightGridBuffer lightGrid;
+
+// Bins this frame's lights and uploads them with the ambient term. The
+// exterior has no lights and keeps its full ambient; the cabin is darker
+// so that its own lights show.
+void updateLights(GLFWwindow* window, const glm::mat4& view, const glm::mat4& proj, bool interior) {
+	static const std::vector<PointLight> noLights;
+	lightClusters.build(interior ? cabinLights[lightOn] : noLights, view, proj);
+	float ambient = !interior ? 1.0f : lightOn ? 0.45f : 0.25f;
+	int width, height;
+	glfwGetFramebufferSize(window, &width, &height);
+	lightGrid.upload(lightClusters, glm::vec3(ambient), width, height);
+
+	const LightClusters::Stats& stats = lightClusters.stats;
+	submitStats.lights += stats.lights;
+	submitStats.visibleLights += stats.visible;
+	submitStats.lightReferences += stats.references;
+	submitStats.occupiedClusters += stats.occupiedClusters;
+	submitStats.maxClusterLights = std::max(submitStats.maxClusterLights, stats.maxPerCluster);
+	submitStats.clusterMs += stats.buildMs;
+}
+
 // Cabin floor
 void drawCabinFloor(glm::mat4 view, glm::mat4 proj) {
 	drawCube(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(-2.0f, -0.55f, 0)), glm::vec3(15.0f, 0.02f, 1.1f)),
@@ -875,77 +1367,1255 @@ void drawCockpitInterior(glm::mat4 view, glm::mat4 proj) {
 		view, proj, glm::vec3(0.15f, 0.2f, 0.25f));
 }
 
-int main() {
-	printControls();
+// Ground & runway
+void drawGround(glm::mat4 view, glm::mat4 proj) {
+	drawCube(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0, -2.0f, 0)), glm::vec3(120, 0.1f, 120)),
+		view, proj, glm::vec3(0.35f, 0.38f, 0.35f));
 
-	glfwInit();
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-	GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, "Realistic Airplane - Cylindrical Design", NULL, NULL);
-	glfwMakeContextCurrent(window);
-	gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
-	glEnable(GL_DEPTH_TEST);
+	drawCube(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0, -1.95f, 0)), glm::vec3(80, 0.02f, 8)),
+		view, proj, glm::vec3(0.25f, 0.25f, 0.28f));
+
+	for (int i = -12; i < 12; i++) {
+		drawCube(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(i * 2.8f, -1.93f, 0)), glm::vec3(1.8f, 0.01f, 0.3f)),
+			view, proj, glm::vec3(0.95f, 0.95f, 0.1f));
+	}
+}
+
+// A draw function and the part group its primitives are binned into
+struct PartDraw {
+	PartGroup group;
+	void (*draw)(glm::mat4, glm::mat4);
+};
+const PartDraw STATIC_EXTERIOR[] = {
+	{PART_GROUND, drawGround},
+	{PART_FUSELAGE, drawFuselage},
+	{PART_FUSELAGE, drawWindows},
+	{PART_FUSELAGE, drawCockpit},
+	{PART_FUSELAGE, drawEmergencyExits},
+	{PART_WINGS, drawWings},
+	{PART_TAIL, drawTailWings},
+	{PART_TAIL, drawVerticalStabilizer},
+	{PART_ENGINES, drawEngines},
+	{PART_GEAR, drawLandingGear},
+};
+const PartDraw LIVE_EXTERIOR[] = {
+	{PART_DOOR, drawDoor},
+	{PART_GEAR, drawWheels},
+};
+const PartDraw CABIN_PARTS[] = {
+	{PART_CABIN, drawCabinFloor},
+	{PART_CABIN, drawAisle},
+	{PART_CABIN, drawCabinSeats},
+	{PART_CABIN, drawOverheadCompartments},
+	{PART_CABIN, drawCabinCeiling},
+	{PART_CABIN, drawGalley},
+	{PART_CABIN, drawLavatory},
+};
+const PartDraw COCKPIT_PARTS[] = {
+	{PART_COCKPIT, drawCockpitInterior},
+};
+
+template <size_t N>
+void drawParts(const PartDraw (&list)[N], glm::mat4 view, glm::mat4 proj) {
+	for (const PartDraw& entry : list) {
+		currentGroup = entry.group;
+		entry.draw(view, proj);
+	}
+}
+
+// A list per draw function of the lists drawn live
+DrawList liveExteriorLists[sizeof(LIVE_EXTERIOR) / sizeof(PartDraw)];
+DrawList cabinLists[sizeof(CABIN_PARTS) / sizeof(PartDraw)];
+DrawList cockpitLists[sizeof(COCKPIT_PARTS) / sizeof(PartDraw)];
+
+struct PartJob {
+	const PartDraw* entry;
+	DrawList* list;
+};
+std::vector<PartJob> partJobs;
+
+void beginDrawList(DrawList& list, size_t reservedLodSlots) {
+	if (list.lods.levelCount() != LOD_COUNT)
+		list.lods.setThresholds(lodThresholds, LOD_COUNT - 1);
+	list.lods.beginFrame(reservedLodSlots);
+	list.commands.clear();
+	list.counters = FrameCounters();
+	list.occlusionStats = MaskedOcclusionBuffer::Stats();
+}
+
+// Hands a list's draws to the primitives' instance buckets
+void mergeDrawList(const DrawList& list) {
+	for (const DrawCommand& command : list.commands)
+		command.primitive->instances.push_back(command.instance);
+	addCounters(frameCounters, list.counters);
+	occlusion.stats.tested += list.occlusionStats.tested;
+	occlusion.stats.occluded += list.occlusionStats.occluded;
+}
 
-	float vertices[] = {
-		-0.5f,-0.5f,-0.5f, 0.5f,-0.5f,-0.5f, 0.5f,0.5f,-0.5f, 0.5f,0.5f,-0.5f, -0.5f,0.5f,-0.5f, -0.5f,-0.5f,-0.5f,
-		-0.5f,-0.5f, 0.5f, 0.5f,-0.5f, 0.5f, 0.5f,0.5f, 0.5f, 0.5f,0.5f, 0.5f, -0.5f,0.5f, 0.5f, -0.5f,-0.5f, 0.5f,
-		-0.5f, 0.5f, 0.5f, -0.5f, 0.5f,-0.5f, -0.5f,-0.5f,-0.5f, -0.5f,-0.5f,-0.5f, -0.5f,-0.5f, 0.5f, -0.5f,0.5f, 0.5f,
-		 0.5f, 0.5f, 0.5f, 0.5f, 0.5f,-0.5f, 0.5f,-0.5f,-0.5f, 0.5f,-0.5f,-0.5f, 0.5f,-0.5f, 0.5f, 0.5f,0.5f, 0.5f,
-		-0.5f,-0.5f,-0.5f, 0.5f,-0.5f,-0.5f, 0.5f,-0.5f, 0.5f, 0.5f,-0.5f, 0.5f, -0.5f,-0.5f, 0.5f, -0.5f,-0.5f,-0.5f,
-		-0.5f, 0.5f,-0.5f, 0.5f, 0.5f,-0.5f, 0.5f, 0.5f, 0.5f, 0.5f,0.5f, 0.5f, -0.5f,0.5f, 0.5f, -0.5f,0.5f,-0.5f
+// Runs on any thread; only reads shared state
+void recordPart(const PartDraw& entry, DrawList& list, glm::mat4 view, glm::mat4 proj) {
+	beginDrawList(list, 0);
+	recording = &list;
+	currentGroup = entry.group;
+	entry.draw(view, proj);
+	recording = nullptr;
+}
+
+template <size_t N>
+void addPartJobs(const PartDraw (&list)[N], DrawList (&lists)[N]) {
+	for (size_t i = 0; i < N; i++)
+		partJobs.push_back({&list[i], &lists[i]});
+}
+
+// Records the queued part jobs on the job system, one job per draw
+// function, then merges their lists in queue order
+void recordPartJobs(glm::mat4 view, glm::mat4 proj) {
+	auto start = std::chrono::steady_clock::now();
+	jobSystem().parallelFor(partJobs.size(), [&](size_t i) {
+		recordPart(*partJobs[i].entry, *partJobs[i].list, view, proj);
+	});
+	for (const PartJob& job : partJobs)
+		mergeDrawList(*job.list);
+	partJobs.clear();
+	submitStats.recordMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Runs every draw function once to collect the bounds of the parts and
+// which view modes draw them. Animated parts are run through
+// their range: the door every 15 degrees, the cabin with lights on and off.
+void surveyParts() {
+	auto start = std::chrono::steady_clock::now();
+	glm::mat4 none(1.0f);
+	float savedDoorAngle = doorAngle;
+	bool savedLightOn = lightOn;
+	surveying = true;
+
+	surveyScene = SCENE_EXTERIOR;
+	drawParts(STATIC_EXTERIOR, none, none);
+	for (doorAngle = 0.0f; doorAngle <= 90.0f; doorAngle += 15.0f)
+		drawParts(LIVE_EXTERIOR, none, none);
+	surveyScene = SCENE_CABIN;
+	for (int light = 0; light < 2; light++) {
+		lightOn = light != 0;
+		drawParts(CABIN_PARTS, none, none);
+	}
+	surveyScene = SCENE_COCKPIT;
+	drawParts(COCKPIT_PARTS, none, none);
+
+	surveying = false;
+	doorAngle = savedDoorAngle;
+	lightOn = savedLightOn;
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	logger().log("Parts from code: %zu surveyed in %.2f ms", parts.size(), ms);
+}
+
+// One BVH per view mode over its parts, surveyed or loaded
+void buildPartTrees() {
+	for (PartScene& scene : partScenes) {
+		std::vector<AABB> boxes;
+		for (int part : scene.parts)
+			boxes.push_back(parts[part].bounds);
+		scene.tree.build(boxes);
+	}
+	partVisible.assign(parts.size(), 1);
+	logger().log("Culling: %zu parts (%zu exterior, %zu cabin, %zu cockpit)", parts.size(),
+		partScenes[SCENE_EXTERIOR].parts.size(), partScenes[SCENE_CABIN].parts.size(), partScenes[SCENE_COCKPIT].parts.size());
+}
+
+// Frustum-culls the parts of the scene on screen into partVisible
+void cullParts(Scene scene, const glm::mat4& viewProj) {
+	const PartScene& partScene = partScenes[scene];
+	BVH::Stats stats;
+	if (cullingEnabled) {
+		stats = partScene.tree.cull(Frustum(viewProj), sceneVisible);
+	} else {
+		sceneVisible.assign(partScene.parts.size(), 1);
+		stats.visible = (int)partScene.parts.size();
+	}
+	for (size_t i = 0; i < partScene.parts.size(); i++)
+		partVisible[partScene.parts[i]] = sceneVisible[i];
+
+	frameCounters.visibleParts += stats.visible;
+	frameCounters.culledParts += stats.culled;
+	frameCounters.nodesTested += stats.nodesTested;
+}
+
+// Interior cells along X and the PVS of the cabin and cockpit scenes. The
+// blockers are the occluders of the scene, i.e. the cores of what it draws:
+// the cabin has no bulkhead, and the galley and lavatory blocks only
+// narrow the aisle; the cockpit divider leaves a gap on every side. The
+// log says how many parts each PVS hides from the average cell.
+void createCells() {
+	auto start = std::chrono::steady_clock::now();
+	const float bottom = -0.6f, top = 1.1f, side = 1.3f;
+	auto cell = [&](float x0, float x1) {
+		AABB box;
+		box.min = glm::vec3(x0, bottom, -side);
+		box.max = glm::vec3(x1, top, side);
+		return box;
 	};
+	std::vector<AABB> cells;
+	cells.push_back(cell(-10.3f, -8.8f));		// lavatory
+	cells.push_back(cell(-8.8f, -6.075f));		// aft of the last row
+	for (int row = 23; row >= 0; row--) {
+		float x = 4.5f - row * 0.45f;
+		cells.push_back(cell(x - 0.225f, x + 0.225f));
+	}
+	cells.push_back(cell(4.725f, 6.24f));		// galley
+	cells.push_back(cell(6.32f, 7.8f));			// cockpit
+
+	partCells.assign(parts.size(), ~0ull);
+	for (Scene scene : {SCENE_CABIN, SCENE_COCKPIT}) {
+		std::vector<AABB> blockers;
+		for (const Occluder& occluder : occluders) {
+			if (occluder.scene == scene)
+				blockers.push_back(occluder.box);
+		}
+		PotentiallyVisibleSet& pvs = scenePvs[scene];
+		PotentiallyVisibleSet::Stats stats = pvs.build(cells, blockers);
+		pvsCulls[scene] = stats.visiblePairs < stats.cells * stats.cells;
+
+		const std::vector<int>& sceneParts = partScenes[scene].parts;
+		for (int part : sceneParts) {
+			uint64_t overlapped = pvs.cellsOverlapping(parts[part].bounds);
+			if (overlapped)
+				partCells[part] = overlapped;
+		}
+		size_t hidden = 0;
+		for (int cell = 0; cell < stats.cells; cell++) {
+			for (int part : sceneParts)
+				hidden += (partCells[part] & pvs.visibleFrom(cell)) ? 0 : 1;
+		}
+		logger().log("PVS %s: %d cells, %.1f visible cells per cell, %.1f of %zu parts hidden from the average cell%s",
+			scene == SCENE_CABIN ? "cabin" : "cockpit", stats.cells, (double)stats.visiblePairs / stats.cells,
+			(double)hidden / stats.cells, sceneParts.size(), pvsCulls[scene] ? "" : ", not tested per frame");
+	}
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	logger().log("PVS built in %.2f ms", ms);
+}
+
+// Drops the parts of the scene whose cells the camera's cell cannot see.
+// A camera outside every cell keeps everything.
+void cullPvs(Scene scene) {
+	if (!pvsEnabled || !pvsCulls[scene])
+		return;
+	const PotentiallyVisibleSet& pvs = scenePvs[scene];
+	int cell = pvs.cellAt(camPos);
+	if (cell < 0)
+		return;
+	uint64_t seen = pvs.visibleFrom(cell);
+	for (int part : partScenes[scene].parts) {
+		if (partVisible[part] && !(partCells[part] & seen)) {
+			partVisible[part] = 0;
+			frameCounters.pvsCulledParts++;
+		}
+	}
+}
+
+void addOccluder(Scene scene, glm::vec3 center, glm::vec3 size) {
+	Occluder occluder;
+	occluder.scene = scene;
+	occluder.box.min = center - 0.5f * size;
+	occluder.box.max = center + 0.5f * size;
+	occluders.push_back(occluder);
+}
+
+// Round parts only contribute the square inscribed in their ring
+// (radius / sqrt 2); the interior blocks are the cubes drawn for them.
+void createOccluders() {
+	float inscribed = 2.0f * 0.7071f;
+	addOccluder(SCENE_EXTERIOR, glm::vec3(-0.825f, 0, 0), glm::vec3(13.15f, 1.1f * inscribed, 1.1f * inscribed));	// fuselage barrel
+	for (float z : {3.0f, -3.0f}) {
+		addOccluder(SCENE_EXTERIOR, glm::vec3(0.9f, -1.0f, z), glm::vec3(2.2f, 0.6f * inscribed, 0.6f * inscribed));	// nacelle
+		addOccluder(SCENE_EXTERIOR, glm::vec3(0.0f, -0.32f, z > 0 ? 1.925f : -1.925f), glm::vec3(2.8f, 0.12f, 2.2f));	// inner wing
+	}
+
+	for (float z : {0.62f, -0.62f})
+		addOccluder(SCENE_CABIN, glm::vec3(5.5f, 0, z), glm::vec3(1.4f, 1.15f, 0.42f));		// galley
+	for (float z : {0.55f, -0.55f})
+		addOccluder(SCENE_CABIN, glm::vec3(-9.5f, 0, z), glm::vec3(1.4f, 1.35f, 0.48f));	// lavatory
 
-	glGenVertexArrays(1, &cubeVAO);
-	glGenBuffers(1, &cubeVBO);
-	glBindVertexArray(cubeVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+	addOccluder(SCENE_COCKPIT, glm::vec3(7.35f, -0.02f, 0), glm::vec3(0.55f, 0.65f, 0.95f));	// instrument panel
+	addOccluder(SCENE_COCKPIT, glm::vec3(7.15f, 0.62f, 0), glm::vec3(0.8f, 0.08f, 0.9f));		// overhead panel
+	addOccluder(SCENE_COCKPIT, glm::vec3(6.28f, 0, 0), glm::vec3(0.08f, 1.2f, 1.0f));			// divider wall
+	for (float z : {0.52f, -0.52f})
+		addOccluder(SCENE_COCKPIT, glm::vec3(6.95f, 0.08f, z), glm::vec3(0.58f, 0.5f, 0.12f));	// side panel
+	for (float z : {0.32f, -0.32f})
+		addOccluder(SCENE_COCKPIT, glm::vec3(6.8f, -0.28f, z), glm::vec3(0.35f, 0.58f, 0.35f));	// pilot seat
+
+	occlusion.resize(256, 192);
+}
+
+// Rasterises the scene's occluders nearest first, then drops the parts
+// that are still visible but hidden behind them
+void cullOccluded(Scene scene, const glm::mat4& viewProj) {
+	occlusion.begin(viewProj, camPos);
+	if (!occlusionEnabled)
+		return;
+
+	std::vector<const Occluder*> sorted;
+	for (const Occluder& occluder : occluders) {
+		if (occluder.scene == scene)
+			sorted.push_back(&occluder);
+	}
+	std::sort(sorted.begin(), sorted.end(), [](const Occluder* a, const Occluder* b) {
+		return glm::length(a->box.center() - camPos) < glm::length(b->box.center() - camPos);
+	});
+	for (const Occluder* occluder : sorted)
+		occlusion.renderBox(occluder->box);
+
+	for (int part : partScenes[scene].parts) {
+		if (partVisible[part] && !occlusion.testBox(parts[part].bounds)) {
+			partVisible[part] = 0;
+			frameCounters.occludedParts++;
+		}
+	}
+}
+
+// Frustum, PVS and occlusion culling of the scene drawn this frame
+void cullScene(Scene scene, const glm::mat4& viewProj) {
+	cullParts(scene, viewProj);
+	cullPvs(scene);
+	cullOccluded(scene, viewProj);
+}
+
+const size_t BAKED_STRIDE = BAKED_FLOATS * sizeof(float);
+
+// position, colour, normal; expects the baked VAO and VBO bound
+void describeBakedVertices() {
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, BAKED_STRIDE, (void*)0);
 	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, BAKED_STRIDE, (void*)(3 * sizeof(float)));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(NORMAL_LOCATION, 3, GL_FLOAT, GL_FALSE, BAKED_STRIDE, (void*)(6 * sizeof(float)));
+	glEnableVertexAttribArray(NORMAL_LOCATION);
+}
+
+// Checks the mapped scene file against itself and this build, before
+// anything is taken from it; the mismatch found, or nullptr
+const char* sceneFileMismatch() {
+	const SceneFileHeader& header = sceneFile.header();
+	if (header.vertexStride != BAKED_STRIDE)
+		return "vertex layout";
+	std::unordered_map<long long, int> keys;
+	for (uint32_t i = 0; i < header.partCount; i++) {
+		const ScenePart& part = sceneFile.parts()[i];
+		bool valid = part.scene < SCENE_COUNT && part.group >= 0 && part.group < PART_GROUP_COUNT &&
+			part.min[0] <= part.max[0] && part.min[1] <= part.max[1] && part.min[2] <= part.max[2] &&
+			keys.emplace(partKey(part.group, part.bin), (int)i).second;
+		if (!valid)
+			return "part table";
+	}
+	for (uint32_t i = 0; i < header.recordCount; i++) {
+		const SceneRecord& record = sceneFile.records()[i];
+		int32_t firstPart = record.primitive == SCENE_CUBE ? 0 : -1;
+		if (record.primitive > SCENE_CONE || record.part < firstPart || record.part >= (int32_t)header.partCount)
+			return "records";
+	}
+	for (uint32_t i = 0; i < header.meshCount; i++) {
+		const SceneMesh& mesh = sceneFile.meshes()[i];
+		size_t indexSize = mesh.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+		bool valid = (mesh.indexType == GL_UNSIGNED_SHORT || mesh.indexType == GL_UNSIGNED_INT) && mesh.part >= 0 && (uint32_t)mesh.part < header.partCount && mesh.baseVertex >= 0 &&
+			((uint64_t)mesh.baseVertex + mesh.vertexCount) * BAKED_STRIDE <= header.vertexBytes &&
+			((uint64_t)mesh.firstIndex + mesh.count) * indexSize <= header.indexBytes;
+		if (!valid)
+			return "meshes";
+	}
+	return nullptr;
+}
+
+// Maps --scene and keeps it mapped if it fits this build. All of it is
+// checked here, so that neither the parts nor the exterior can fail half
+// way through; otherwise everything is built from code.
+bool openSceneFile(const char* path) {
+	if (!sceneFile.open(path)) {
+		logger().log("Scene %s: %s, building from code", path, sceneFile.error().c_str());
+		return false;
+	}
+	if (const char* mismatch = sceneFileMismatch()) {
+		logger().log("Scene %s: %s do not match this model, building from code", path, mismatch);
+		sceneFile.close();
+		return false;
+	}
+	return true;
+}
+
+// Takes the culling parts from the scene file's part table in place of
+// surveyParts(); the ids are the table's order, which the records and
+// meshes refer to
+void loadParts() {
+	auto start = std::chrono::steady_clock::now();
+	const SceneFileHeader& header = sceneFile.header();
+	for (uint32_t i = 0; i < header.partCount; i++) {
+		const ScenePart& part = sceneFile.parts()[i];
+		AABB bounds;
+		bounds.min = glm::vec3(part.min[0], part.min[1], part.min[2]);
+		bounds.max = glm::vec3(part.max[0], part.max[1], part.max[2]);
+		int id = (int)parts.size();
+		parts.push_back({(PartGroup)part.group, part.bin, bounds});
+		partIndex[partKey(part.group, part.bin)] = id;
+		partScenes[part.scene].parts.push_back(id);
+	}
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	logger().log("Parts from scene file: %zu loaded in %.2f ms", parts.size(), ms);
+}
+
+// Uploads the chunks captured into exteriorBatch as one pool
+void uploadChunks(size_t& vertexCount, size_t& indexCount, int& chunkCount) {
+	vertexCount = 0;
+	indexCount = 0;
+	chunkCount = 0;
+	for (const BatchChunk& chunk : exteriorBatch.chunks) {
+		vertexCount += chunk.vertices.size() / BAKED_FLOATS;
+		indexCount += chunk.indices.size();
+		chunkCount += chunk.indices.empty() ? 0 : 1;
+	}
+
+	// uint16 chunks pad to four bytes, which uint32 sizing always covers
+	bakedGeometry.create(BAKED_STRIDE, vertexCount, indexCount * sizeof(unsigned int));
+	describeBakedVertices();
+	for (BatchChunk& chunk : exteriorBatch.chunks) {
+		if (chunk.indices.empty())
+			continue;
+		chunk.mesh = bakedGeometry.add(chunk.vertices.data(), chunk.vertices.size() / BAKED_FLOATS, chunk.indices.data(), chunk.indices.size());
+	}
+}
+
+// Drops the CPU copies of the chunks once they are on the GPU
+void releaseChunks() {
+	for (BatchChunk& chunk : exteriorBatch.chunks) {
+		std::vector<float>().swap(chunk.vertices);
+		std::vector<unsigned int>().swap(chunk.indices);
+	}
+}
+
+// Fills exteriorBatch from the mapped scene file. The records are the
+// scene: round ones stay live for LOD and every cube is counted. If the
+// file has baked meshes, the buffer images go to the GPU straight from
+// the mapping; if not, the cube records are baked here first.
+void loadExterior() {
+	const SceneFileHeader& header = sceneFile.header();
+	bool baked = header.meshCount > 0;
+	exteriorBatch.chunks.resize(parts.size());
+	if (baked) {
+		bakedGeometry.createFilled(BAKED_STRIDE, sceneFile.vertexData(), header.vertexBytes / BAKED_STRIDE, sceneFile.indexData(), header.indexBytes);
+		describeBakedVertices();
+		for (uint32_t i = 0; i < header.meshCount; i++) {
+			const SceneMesh& mesh = sceneFile.meshes()[i];
+			exteriorBatch.chunks[mesh.part].mesh = mesh.mesh();
+		}
+	}
+
+	captureBatch = baked ? nullptr : &exteriorBatch;
+	for (uint32_t i = 0; i < header.recordCount; i++) {
+		const SceneRecord& record = sceneFile.records()[i];
+		glm::vec3 color(record.color[0], record.color[1], record.color[2]);
+		if (record.primitive == SCENE_CUBE) {
+			if (captureBatch)
+				capturePrimitive(cubeShape, record.transform.toMat4(), color, record.part);
+			else
+				exteriorBatch.primitives++;
+			continue;
+		}
+		Primitive* levels = record.primitive == SCENE_CYLINDER ? cylinderLods : coneLods;
+		exteriorBatch.roundDraws.push_back({levels, record.transform.toMat4(), color, record.part});
+	}
+	captureBatch = nullptr;
+
+	if (baked) {
+		logger().log("Loaded %d static exterior primitives in %u part chunks (%llu vertex, %llu index bytes) from %s, %zu round parts kept for LOD",
+			exteriorBatch.primitives, header.meshCount, (unsigned long long)header.vertexBytes, (unsigned long long)header.indexBytes,
+			sceneFilePath, exteriorBatch.roundDraws.size());
+		return;
+	}
+	size_t vertexCount, indexCount;
+	int chunkCount;
+	uploadChunks(vertexCount, indexCount, chunkCount);
+	releaseChunks();
+	logger().log("Baked %d static exterior primitives from the records of %s into %d part chunks (%zu vertices, %zu indices), %zu round parts kept for LOD",
+		exteriorBatch.primitives, sceneFilePath, chunkCount, vertexCount, indexCount, exteriorBatch.roundDraws.size());
+}
+
+// Runs the static exterior draw functions once in capture mode and uploads
+// the merged chunks, or loads them from --scene. The door and the wheels
+// move, so they stay live. Either way the time is logged, export excluded.
+void bakeExterior() {
+	auto start = std::chrono::steady_clock::now();
+	auto elapsedMs = [&] { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(); };
+	if (sceneFile.isOpen()) {
+		loadExterior();
+		sceneFile.close();
+		logger().log("Static exterior from scene file: %.2f ms", elapsedMs());
+		return;
+	}
+
+	glm::mat4 none(1.0f);
+	SceneWriter writer(BAKED_STRIDE);
+	sceneExport = exportScenePath ? &writer : nullptr;
+	captureBatch = &exteriorBatch;
+	exteriorBatch.chunks.resize(parts.size());
+	drawParts(STATIC_EXTERIOR, none, none);
+	captureBatch = nullptr;
+	sceneExport = nullptr;
+
+	size_t vertexCount, indexCount;
+	int chunkCount;
+	uploadChunks(vertexCount, indexCount, chunkCount);
+	double bakeMs = elapsedMs();
+
+	if (exportScenePath) {
+		// in id order, which the records and meshes refer to
+		std::vector<uint32_t> partScene(parts.size());
+		for (int scene = 0; scene < SCENE_COUNT; scene++) {
+			for (int part : partScenes[scene].parts)
+				partScene[part] = (uint32_t)scene;
+		}
+		for (size_t id = 0; id < parts.size(); id++) {
+			const Part& part = parts[id];
+			writer.addPart(partScene[id], part.group, part.bin, part.bounds.min, part.bounds.max);
+		}
+		for (size_t part = 0; part < exteriorBatch.chunks.size(); part++) {
+			const BatchChunk& chunk = exteriorBatch.chunks[part];
+			if (!chunk.indices.empty())
+				writer.addMesh((int)part, chunk.vertices.data(), chunk.vertices.size() / BAKED_FLOATS, chunk.indices.data(), chunk.indices.size());
+		}
+		if (writer.save(exportScenePath))
+			logger().log("Exported %zu parts and %zu primitives to %s", parts.size(), writer.recordCount(), exportScenePath);
+		else
+			logger().log("Could not write %s", exportScenePath);
+	}
+	releaseChunks();
+
+	logger().log("Baked %d static exterior primitives into %d part chunks (%zu vertices, %zu indices), %zu round parts kept for LOD",
+		exteriorBatch.primitives, chunkCount, vertexCount, indexCount, exteriorBatch.roundDraws.size());
+	logger().log("Static exterior from code: %.2f ms", bakeMs);
+}
+
+float queueDepth(glm::mat4 view, glm::vec3 point) {
+	return depthSortEnabled ? RenderQueue::viewDepth(view, point) : 0.0f;
+}
+
+// Moves this frame's instances into renderQueue and sorts it. The
+// multi-draw path leaves the primitive type out of the key, every draw
+// being its own command there.
+void queueInstances(glm::mat4 view, bool multiDrawn) {
+	auto start = std::chrono::steady_clock::now();
+	std::vector<Primitive*> primitives = {&cubeShape};
+	for (int i = 0; i < LOD_COUNT; i++) {
+		primitives.push_back(&cylinderLods[i]);
+		primitives.push_back(&coneLods[i]);
+	}
+	QueueProgram program = multiDrawn ? PROGRAM_MULTI_DRAW : PROGRAM_INSTANCED;
+	for (size_t p = 0; p < primitives.size(); p++) {
+		Primitive* primitive = primitives[p];
+		submitStats.draws += primitive->instances.size();
+		frameCounters.triangles += primitive->instances.size() * (primitive->mesh.count / 3);
+		unsigned int material = multiDrawn ? 0 : (unsigned int)p;
+		for (const ColoredInstance& instance : primitive->instances) {
+			uint64_t key = RenderQueue::makeKey(program, VAO_PRIMITIVES, material, queueDepth(view, glm::vec3(instance.model[3])));
+			renderQueue.add(key, primitive->mesh, clusteredLighting ? withNormalMatrix(instance) : instance);
+		}
+		primitive->instances.clear();
+	}
+	renderQueue.sort();
+	submitStats.cpuMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Replays renderQueue. The program and VAO are only switched where the key
+// changes, and each run becomes one call: a multi-draw of baked chunks, an
+// instanced draw of one primitive type, or one indirect multi-draw of
+// everything. View and projection come from the Camera uniform block, set
+// once per frame. The queue is kept, so a depth pre-pass can replay it;
+// its calls are counted apart from the colour pass.
+void replayQueue(const Shader* const* programs, bool prepass = false) {
+	auto start = std::chrono::steady_clock::now();
+	unsigned int boundProgram = PROGRAM_COUNT, boundVao = ~0u;
+	for (size_t first = 0; first < renderQueue.size();) {
+		size_t count = renderQueue.runLength(first);
+		uint64_t key = renderQueue.key(first);
+		unsigned int program = RenderQueue::programOf(key);
+		if (program != boundProgram) {
+			programs[program]->use();
+			boundProgram = program;
+			submitStats.programChanges++;
+		}
+		unsigned int vao = RenderQueue::vaoOf(key);
+		if (vao != boundVao) {
+			(vao == VAO_BAKED ? bakedGeometry : geometry).bind();
+			boundVao = vao;
+			submitStats.vaoChanges++;
+		}
+
+		if (program == PROGRAM_BATCH) {
+			runMeshes.clear();
+			for (size_t i = first; i < first + count; i++)
+				runMeshes.push_back(&renderQueue.mesh(i));
+			bakedGeometry.drawMany(runMeshes.data(), runMeshes.size());
+		} else if (program == PROGRAM_INSTANCED) {
+			primitiveInstances.upload(renderQueue.instanceData(first), count);
+			geometry.drawInstanced(renderQueue.mesh(first), (GLsizei)count);
+		} else if (program == PROGRAM_FLEET) {
+			primitiveInstances.upload(renderQueue.instanceData(first), count);
+			bakedGeometry.drawInstanced(renderQueue.mesh(first), (GLsizei)count);
+		} else {
+			for (size_t i = first; i < first + count; i++)
+				multiDraw.add(renderQueue.mesh(i), renderQueue.instance(i));
+			multiDraw.submit(geometry);
+		}
+		if (prepass) {
+			submitStats.prepassCalls++;
+		} else {
+			submitStats.calls++;
+			submitStats.runs++;
+			frameCounters.drawCalls++;
+		}
+		first += count;
+	}
+	submitStats.cpuMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Adds the frame to the submit statistics and logs them every 5 s
+void reportSubmitStats(bool multiDrawn) {
+	submitStats.frames++;
+	submitStats.visibleParts += frameCounters.visibleParts;
+	submitStats.culledParts += frameCounters.culledParts;
+	submitStats.occludedParts += frameCounters.occludedParts;
+	submitStats.occludedDraws += frameCounters.occludedDraws;
+	submitStats.pvsCulledParts += frameCounters.pvsCulledParts;
+	submitStats.shadedFragments += frameCounters.shadedFragments;
+	submitStats.coveredPixels += frameCounters.coveredPixels;
+	submitStats.screenPixels += frameCounters.screenPixels;
+	double now = glfwGetTime();
+	if (now - submitStats.reportTime >= 5.0) {
+		logger().log("Submit (%s%s): %.0f primitives in %.1f calls, %.3f ms CPU per frame",
+			multiDrawn ? "multi-draw indirect" : "instanced", depthSortEnabled ? ", front to back" : "",
+			(double)submitStats.draws / submitStats.frames, (double)submitStats.calls / submitStats.frames, submitStats.cpuMs / submitStats.frames);
+		if (depthPrepass)
+			logger().log("Depth pre-pass: %.1f calls per frame", (double)submitStats.prepassCalls / submitStats.frames);
+		logger().log("Record (%u threads): %.3f ms per frame", jobSystem().threadCount(), submitStats.recordMs / submitStats.frames);
+		logger().log("Render queue: %.1f runs, %.1f program and %.1f VAO changes per frame",
+			(double)submitStats.runs / submitStats.frames, (double)submitStats.programChanges / submitStats.frames,
+			(double)submitStats.vaoChanges / submitStats.frames);
+		logger().log("Culling%s: %.1f parts visible, %.1f culled, %.1f PVS culled, %.1f occluded, %.1f live draws occluded per frame",
+			cullingEnabled ? "" : " (off)", (double)submitStats.visibleParts / submitStats.frames,
+			(double)submitStats.culledParts / submitStats.frames, (double)submitStats.pvsCulledParts / submitStats.frames,
+			(double)submitStats.occludedParts / submitStats.frames, (double)submitStats.occludedDraws / submitStats.frames);
+		if (clusteredLighting && submitStats.lights > 0) {
+			logger().log("Lights: %.0f of %.0f visible, %.1f per occupied cluster (max %d), %.3f ms binning per frame",
+				(double)submitStats.visibleLights / submitStats.frames, (double)submitStats.lights / submitStats.frames,
+				submitStats.occupiedClusters ? (double)submitStats.lightReferences / submitStats.occupiedClusters : 0.0,
+				submitStats.maxClusterLights, submitStats.clusterMs / submitStats.frames);
+		}
+		if (overdrawView && submitStats.coveredPixels > 0) {
+			logger().log("Overdraw%s: %.2f fragments shaded per covered pixel, %.0f%% of the screen covered",
+				depthPrepass ? " (after depth pre-pass)" : "", (double)submitStats.shadedFragments / submitStats.coveredPixels,
+				100.0 * submitStats.coveredPixels / submitStats.screenPixels);
+		}
+		submitStats = SubmitStats();
+		submitStats.reportTime = now;
+	}
+}
+
+// Queues the chunks of the visible parts and the round parts at their LOD
+void queueStaticBatch(const StaticBatch& batch, glm::mat4 view, glm::mat4 proj) {
+	beginDrawList(staticList, batch.roundDraws.size());
+	static const ColoredInstance baked = {glm::mat4(1.0f), glm::vec4(1.0f)};
+	for (size_t part = 0; part < batch.chunks.size(); part++) {
+		const Mesh& mesh = batch.chunks[part].mesh;
+		if (mesh.count == 0 || !partVisible[part])
+			continue;
+		uint64_t key = RenderQueue::makeKey(PROGRAM_BATCH, VAO_BAKED, 0, queueDepth(view, parts[part].bounds.center()));
+		renderQueue.add(key, mesh, baked);
+		frameCounters.triangles += mesh.count / 3;
+	}
+
+	recording = &staticList;
+	for (size_t i = 0; i < batch.roundDraws.size(); i++) {
+		const RoundDraw& round = batch.roundDraws[i];
+		if (round.part < 0 || partVisible[round.part])
+			queueRound(round.levels, round.model, round.color, view, proj, (int)i);
+	}
+	recording = nullptr;
+	mergeDrawList(staticList);
+}
+
+// --airport N: N aircraft on a grid of stands around the original ground.
+// The baked exterior is the same for all of them, so each part chunk is
+// one instanced draw for the whole fleet with the placement as instance
+// matrix; the door and wheels are recorded per aircraft with its own
+// angles. Part culling and the occlusion buffer work in the space of the
+// single aircraft, so on the apron whole aircraft are frustum culled.
+const size_t LIVE_EXTERIOR_COUNT = sizeof(LIVE_EXTERIOR) / sizeof(PartDraw);
+int airportCount = 0;
+std::vector<Aircraft> fleet;
+std::vector<DrawList> fleetLists;			// LIVE_EXTERIOR_COUNT per aircraft
+std::vector<unsigned char> aircraftVisible;
+glm::mat4 apron(1.0f);						// ground under the stands
+float apronRadius = 0.0f;
+
+// Stands in rows facing alternate ways; door and wheel state are spread
+// over the fleet so no two neighbours look the same
+void createFleet(int count) {
+	AABB local;
+	for (const Part& part : parts) {
+		if (part.group != PART_GROUND)
+			local.expand(part.bounds);
+	}
+	glm::vec3 size = local.max - local.min;
+	float spacing = std::max(size.x, size.z) + 6.0f;
+	int columns = (int)std::ceil(std::sqrt((double)count));
+	int rows = (count + columns - 1) / columns;
+
+	fleet.assign(count, Aircraft());
+	for (int i = 0; i < count; i++) {
+		int row = i / columns, column = i % columns;
+		glm::vec3 stand((column - (columns - 1) * 0.5f) * spacing, 0.0f, (row - (rows - 1) * 0.5f) * spacing);
+		Aircraft& aircraft = fleet[i];
+		aircraft.placement = glm::rotate(glm::translate(glm::mat4(1.0f), stand), glm::radians(row % 2 ? 180.0f : 0.0f), glm::vec3(0, 1, 0));
+		aircraft.doorAngle = (float)(i * 37 % 91);
+		aircraft.wheelRotation = (float)(i * 53 % 360);
+		for (int corner = 0; corner < 8; corner++) {
+			glm::vec3 point((corner & 1) ? local.max.x : local.min.x, (corner & 2) ? local.max.y : local.min.y, (corner & 4) ? local.max.z : local.min.z);
+			AABB box;
+			box.min = box.max = glm::vec3(aircraft.placement * glm::vec4(point, 1.0f));
+			aircraft.bounds.expand(box);
+		}
+	}
+	fleetLists.assign(fleet.size() * LIVE_EXTERIOR_COUNT, DrawList());
+	for (size_t i = 0; i < fleetLists.size(); i++)
+		fleetLists[i].aircraft = &fleet[i / LIVE_EXTERIOR_COUNT];
+	aircraftVisible.assign(fleet.size(), 0);
+
+	glm::vec2 extent(columns * spacing * 0.5f + 10.0f, rows * spacing * 0.5f + 10.0f);
+	apron = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -2.06f, 0.0f)), glm::vec3(extent.x * 2.0f, 0.1f, extent.y * 2.0f));
+	apronRadius = glm::length(extent);
+	airportCount = count;
+	logger().log("Airport: %d aircraft on a %dx%d grid of stands %.1f apart", count, columns, rows, spacing);
+}
+
+// queueStaticBatch() for the apron: culls whole aircraft, queues every
+// chunk once per visible aircraft (a run per chunk, so one instanced draw
+// each), the round parts per aircraft in their own LOD slots, and the
+// ground once. Aircraft are counted as the frame's visible and culled parts.
+void queueFleet(const StaticBatch& batch, glm::mat4 view, glm::mat4 proj) {
+	Frustum frustum(proj * view);
+	size_t rounds = batch.roundDraws.size();
+	beginDrawList(staticList, (fleet.size() + 1) * rounds);
+	recording = &staticList;
+	for (size_t a = 0; a < fleet.size(); a++) {
+		const Aircraft& aircraft = fleet[a];
+		aircraftVisible[a] = frustum.classify(aircraft.bounds) != Frustum::OUTSIDE;
+		if (!aircraftVisible[a]) {
+			frameCounters.culledParts++;
+			continue;
+		}
+		frameCounters.visibleParts++;
+		ColoredInstance instance = withNormalMatrix({aircraft.placement, glm::vec4(1.0f)});
+		float depth = queueDepth(view, glm::vec3(aircraft.placement[3]));
+		for (size_t part = 0; part < batch.chunks.size(); part++) {
+			const Mesh& mesh = batch.chunks[part].mesh;
+			if (mesh.count == 0 || parts[part].group == PART_GROUND)
+				continue;
+			renderQueue.add(RenderQueue::makeKey(PROGRAM_FLEET, VAO_BAKED, (unsigned int)part, depth), mesh, instance);
+			frameCounters.triangles += mesh.count / 3;
+		}
+		for (size_t i = 0; i < rounds; i++) {
+			const RoundDraw& round = batch.roundDraws[i];
+			if (round.part >= 0 && parts[round.part].group != PART_GROUND)
+				queueRound(round.levels, aircraft.placement * round.model, round.color, view, proj, (int)(a * rounds + i));
+		}
+	}
+
+	static const ColoredInstance baked = {glm::mat4(1.0f), glm::vec4(1.0f)};
+	for (size_t part = 0; part < batch.chunks.size(); part++) {
+		const Mesh& mesh = batch.chunks[part].mesh;
+		if (mesh.count == 0 || parts[part].group != PART_GROUND)
+			continue;
+		renderQueue.add(RenderQueue::makeKey(PROGRAM_BATCH, VAO_BAKED, 0, queueDepth(view, parts[part].bounds.center())), mesh, baked);
+		frameCounters.triangles += mesh.count / 3;
+	}
+	for (size_t i = 0; i < rounds; i++) {
+		const RoundDraw& round = batch.roundDraws[i];
+		if (round.part < 0 || parts[round.part].group == PART_GROUND)
+			queueRound(round.levels, round.model, round.color, view, proj, (int)(fleet.size() * rounds + i));
+	}
+	staticList.commands.push_back({&cubeShape, {apron, glm::vec4(0.33f, 0.36f, 0.33f, 1.0f)}});
+	recording = nullptr;
+	mergeDrawList(staticList);
+}
 
-	createCylinderVAO();
-	createConeVAO();
-	createDiskVAO();
+void addFleetJobs() {
+	for (size_t a = 0; a < fleet.size(); a++) {
+		if (!aircraftVisible[a])
+			continue;
+		for (size_t i = 0; i < LIVE_EXTERIOR_COUNT; i++)
+			partJobs.push_back({&LIVE_EXTERIOR[i], &fleetLists[a * LIVE_EXTERIOR_COUNT + i]});
+	}
+}
+
+// --airport-bench: shows each fleet size of AIRPORT_SWEEP from above the
+// apron and logs frame time, draw calls and triangles over
+// AIRPORT_BENCH_FRAMES frames after a warm-up
+const int AIRPORT_SWEEP[] = {1, 10, 100, 500};
+const int AIRPORT_SWEEP_STEPS = sizeof(AIRPORT_SWEEP) / sizeof(int);
+const int AIRPORT_BENCH_WARMUP = 30;
+const int AIRPORT_BENCH_FRAMES = 120;
+
+struct AirportBench {
+	bool active = false;
+	int step = 0;
+	int frame = 0;
+	double start = 0.0;
+	FrameCounters sum;
+};
+AirportBench airportBench;
+
+// Looks at the apron centre from above its near edge
+void viewApron() {
+	camPos = glm::vec3(0.0f, 8.0f + apronRadius * 0.45f, 12.0f + apronRadius * 0.9f);
+	glm::vec3 dir = glm::normalize(-camPos);
+	yaw = glm::degrees(atan2(dir.z, dir.x));
+	pitch = glm::degrees(asin(dir.y));
+	roll = 0.0f;
+}
+
+void startAirportStep() {
+	createFleet(AIRPORT_SWEEP[airportBench.step]);
+	viewApron();
+	airportBench.frame = 0;
+	airportBench.sum = FrameCounters();
+}
+
+// Called after every frame; returns false once the sweep is done
+bool recordAirportBench() {
+	AirportBench& bench = airportBench;
+	bench.frame++;
+	if (bench.frame <= AIRPORT_BENCH_WARMUP) {
+		bench.start = glfwGetTime();
+		return true;
+	}
+	addCounters(bench.sum, frameCounters);
+	if (bench.frame < AIRPORT_BENCH_WARMUP + AIRPORT_BENCH_FRAMES)
+		return true;
+
+	double frames = AIRPORT_BENCH_FRAMES;
+	logger().log("Airport bench: %4d aircraft, %.2f ms per frame, %.0f draw calls, %.0f triangles, %.0f aircraft visible",
+		airportCount, (glfwGetTime() - bench.start) * 1000.0 / frames, bench.sum.drawCalls / frames,
+		bench.sum.triangles / frames, bench.sum.visibleParts / frames);
+	if (++bench.step == AIRPORT_SWEEP_STEPS)
+		return false;
+	startAirportStep();
+	return true;
+}
 
-	shader = glCreateProgram();
-	std::string vCode = loadShader("vertex.vs"), fCode = loadShader("fragment.fs");
-	const char* vSrc = vCode.c_str(), * fSrc = fCode.c_str();
+// Adds the stencil counts of the frame just drawn to frameCounters. The
+// read-back stalls until the GPU is done, which only --overdraw pays for.
+void measureOverdraw(GLFWwindow* window) {
+	int width, height;
+	glfwGetFramebufferSize(window, &width, &height);
+	stencilPixels.resize((size_t)width * height);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_STENCIL_INDEX, GL_UNSIGNED_BYTE, stencilPixels.data());
+	for (unsigned char layers : stencilPixels) {
+		frameCounters.shadedFragments += layers;
+		if (layers)
+			frameCounters.coveredPixels++;
+	}
+	frameCounters.screenPixels += stencilPixels.size();
+}
 
-	unsigned int vs = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vs, 1, &vSrc, NULL);
-	glCompileShader(vs);
+// Scripted camera for --camera-path. Each leg circles the airplane centre
+// while the distance changes geometrically, and time advances a fixed
+// 1/60 s per frame so runs on different machines see the same views.
+struct CameraLeg {
+	const char* name;
+	float seconds;
+	float radius0, radius1;
+	float height0, height1;
+	float angle0, angle1;	// degrees around Y
+};
+const CameraLeg CAMERA_PATH[] = {
+	{"close orbit", 10.0f, 7.0f, 7.0f, 3.0f, 3.0f, 0.0f, 360.0f},
+	{"pull-out", 10.0f, 7.0f, 100.0f, 3.0f, 20.0f, 45.0f, 45.0f},
+	{"far orbit", 10.0f, 60.0f, 60.0f, 10.0f, 10.0f, 0.0f, 360.0f},
+};
+const int CAMERA_PATH_LEGS = sizeof(CAMERA_PATH) / sizeof(CAMERA_PATH[0]);
+
+struct CameraPath {
+	bool active = false;
+	int leg = 0;
+	int frame = 0;
+	FrameCounters sum;
+};
+CameraPath cameraPath;
+
+// Places the camera for the current frame of the current leg
+void advanceCameraPath() {
+	const CameraLeg& leg = CAMERA_PATH[cameraPath.leg];
+	float s = cameraPath.frame / (leg.seconds * 60.0f);
+	float radius = leg.radius0 * pow(leg.radius1 / leg.radius0, s);
+	float angle = glm::radians(leg.angle0 + (leg.angle1 - leg.angle0) * s);
+	camPos = glm::vec3(radius * cos(angle), leg.height0 + (leg.height1 - leg.height0) * s, radius * sin(angle));
+
+	glm::vec3 dir = glm::normalize(-camPos);
+	yaw = glm::degrees(atan2(dir.z, dir.x));
+	pitch = glm::degrees(asin(dir.y));
+	roll = 0.0f;
+}
 
-	int success;
-	char infoLog[512];
-	glGetShaderiv(vs, GL_COMPILE_STATUS, &success);
-	if (!success) {
-		glGetShaderInfoLog(vs, 512, NULL, infoLog);
-		std::cerr << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+// Adds the frame's counters to the leg and reports the leg when it ends.
+// Returns false after the last leg.
+bool recordCameraPath() {
+	addCounters(cameraPath.sum, frameCounters);
+
+	const CameraLeg& leg = CAMERA_PATH[cameraPath.leg];
+	if (++cameraPath.frame < (int)(leg.seconds * 60.0f))
+		return true;
+
+	double frames = cameraPath.frame;
+	const FrameCounters& sum = cameraPath.sum;
+	logger().log("Camera path '%s': %.0f triangles/frame, round parts %.0f (%.0f at %d segments)",
+		leg.name, sum.triangles / frames, sum.roundTriangles / frames, sum.baselineRoundTriangles / frames, LOD_SEGMENTS[LOD_BASELINE]);
+	logger().log("Camera path '%s': round draws per frame by LOD %.1f/%.1f/%.1f/%.1f",
+		leg.name, sum.levelDraws[0] / frames, sum.levelDraws[1] / frames, sum.levelDraws[2] / frames, sum.levelDraws[3] / frames);
+	logger().log("Camera path '%s': %.1f parts visible, %.1f culled, %.1f BVH nodes tested per frame",
+		leg.name, sum.visibleParts / frames, sum.culledParts / frames, sum.nodesTested / frames);
+	logger().log("Camera path '%s': %.1f parts PVS culled, %.1f parts and %.1f live draws occluded per frame",
+		leg.name, sum.pvsCulledParts / frames, sum.occludedParts / frames, sum.occludedDraws / frames);
+	if (overdrawView && sum.coveredPixels > 0) {
+		logger().log("Camera path '%s': %.2f fragments shaded per covered pixel",
+			leg.name, (double)sum.shadedFragments / sum.coveredPixels);
 	}
 
-	unsigned int fs = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fs, 1, &fSrc, NULL);
-	glCompileShader(fs);
+	cameraPath.sum = FrameCounters();
+	cameraPath.frame = 0;
+	return ++cameraPath.leg < CAMERA_PATH_LEGS;
+}
 
-	glGetShaderiv(fs, GL_COMPILE_STATUS, &success);
-	if (!success) {
-		glGetShaderInfoLog(fs, 512, NULL, infoLog);
-		std::cerr << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+// --trs-bench: composes TRS_BENCH_COUNT model matrices with the glm chain
+// (translate, three rotates, scale) and with the batch kernels, Euler and
+// quaternion, without and with a parent, and logs the time per matrix and
+// the largest difference from glm.
+const int TRS_BENCH_COUNT = 100000;
+const int TRS_BENCH_ROUNDS = 20;
+
+float largestDifference(const std::vector<glm::mat4>& expected, const std::vector<AffineMatrix>& actual) {
+	float largest = 0.0f;
+	for (size_t i = 0; i < expected.size(); i++) {
+		glm::mat4 m = actual[i].toMat4();
+		for (int c = 0; c < 4; c++)
+			for (int r = 0; r < 3; r++)
+				largest = std::max(largest, std::fabs(m[c][r] - expected[i][c][r]));
 	}
+	return largest;
+}
 
-	glAttachShader(shader, vs);
-	glAttachShader(shader, fs);
-	glLinkProgram(shader);
+void runTransformBenchmark() {
+	TransformArrays euler, quaternions;
+	std::vector<glm::vec3> axes;
+	std::vector<float> angles;
+	srand(1);
+	auto random = [](float low, float high) { return low + (high - low) * rand() / RAND_MAX; };
+	for (int i = 0; i < TRS_BENCH_COUNT; i++) {
+		glm::vec3 position(random(-30.0f, 30.0f), random(-5.0f, 5.0f), random(-30.0f, 30.0f));
+		glm::vec3 scale(random(0.1f, 2.0f), random(0.1f, 2.0f), random(0.1f, 2.0f));
+		euler.add(position, glm::vec4(random(-180.0f, 180.0f), random(-180.0f, 180.0f), random(-180.0f, 180.0f), 0.0f), scale);
+		glm::vec3 axis = glm::normalize(glm::vec3(random(-1.0f, 1.0f), random(-1.0f, 1.0f), random(0.1f, 1.0f)));
+		float angle = random(-3.14159f, 3.14159f);
+		axes.push_back(axis);
+		angles.push_back(angle);
+		quaternions.add(position, glm::vec4(axis * std::sin(angle * 0.5f), std::cos(angle * 0.5f)), scale);
+	}
+	glm::mat4 parentMatrix = glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(12.0f, 0.0f, -40.0f)), glm::radians(30.0f), glm::vec3(0, 1, 0));
+	AffineMatrix parent = AffineMatrix::fromMat4(parentMatrix);
 
-	glGetProgramiv(shader, GL_LINK_STATUS, &success);
-	if (!success) {
-		glGetProgramInfoLog(shader, 512, NULL, infoLog);
-		std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+	std::vector<glm::mat4> expected(TRS_BENCH_COUNT);
+	std::vector<AffineMatrix> matrices(TRS_BENCH_COUNT);
+	auto perMatrix = [](std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ((double)TRS_BENCH_COUNT * TRS_BENCH_ROUNDS);
+	};
+#if defined(TRANSFORM_AVX)
+	const char* path = "AVX";
+#elif defined(TRANSFORM_SSE)
+	const char* path = "SSE";
+#else
+	const char* path = "scalar";
+#endif
+	logger().log("TRS bench: %d matrices, %s kernels", TRS_BENCH_COUNT, path);
+
+	for (int withParent = 0; withParent < 2; withParent++) {
+		const AffineMatrix* parentPointer = withParent ? &parent : nullptr;
+		glm::mat4 base = withParent ? parentMatrix : glm::mat4(1.0f);
+
+		auto start = std::chrono::steady_clock::now();
+		for (int round = 0; round < TRS_BENCH_ROUNDS; round++) {
+			for (int i = 0; i < TRS_BENCH_COUNT; i++) {
+				glm::mat4 m = glm::translate(base, glm::vec3(euler.position[0][i], euler.position[1][i], euler.position[2][i]));
+				m = glm::rotate(m, glm::radians(euler.rotation[0][i]), glm::vec3(1, 0, 0));
+				m = glm::rotate(m, glm::radians(euler.rotation[1][i]), glm::vec3(0, 1, 0));
+				m = glm::rotate(m, glm::radians(euler.rotation[2][i]), glm::vec3(0, 0, 1));
+				expected[i] = glm::scale(m, glm::vec3(euler.scale[0][i], euler.scale[1][i], euler.scale[2][i]));
+			}
+		}
+		double glmEuler = perMatrix(start);
+		start = std::chrono::steady_clock::now();
+		for (int round = 0; round < TRS_BENCH_ROUNDS; round++)
+			composeEulerTransforms(euler, matrices.data(), parentPointer);
+		double batchEuler = perMatrix(start);
+		logger().log("TRS bench: Euler%s, glm %.1f ns, batch %.1f ns per matrix (%.1fx), largest difference %g",
+			withParent ? " with parent" : "", glmEuler, batchEuler, glmEuler / batchEuler, largestDifference(expected, matrices));
+
+		start = std::chrono::steady_clock::now();
+		for (int round = 0; round < TRS_BENCH_ROUNDS; round++) {
+			for (int i = 0; i < TRS_BENCH_COUNT; i++) {
+				glm::mat4 m = glm::translate(base, glm::vec3(quaternions.position[0][i], quaternions.position[1][i], quaternions.position[2][i]));
+				m = glm::rotate(m, angles[i], axes[i]);
+				expected[i] = glm::scale(m, glm::vec3(quaternions.scale[0][i], quaternions.scale[1][i], quaternions.scale[2][i]));
+			}
+		}
+		double glmQuaternion = perMatrix(start);
+		start = std::chrono::steady_clock::now();
+		for (int round = 0; round < TRS_BENCH_ROUNDS; round++)
+			composeQuaternionTransforms(quaternions, matrices.data(), parentPointer);
+		double batchQuaternion = perMatrix(start);
+		logger().log("TRS bench: quaternion%s, glm %.1f ns, batch %.1f ns per matrix (%.1fx), largest difference %g",
+			withParent ? " with parent" : "", glmQuaternion, batchQuaternion, glmQuaternion / batchQuaternion, largestDifference(expected, matrices));
 	}
+}
 
-	glDeleteShader(vs);
-	glDeleteShader(fs);
+// --job-bench: builds the CPU side of an --airport frame for a fleet of
+// JOB_BENCH_AIRCRAFT seen from above the apron (queueFleet, the live
+// exterior of every visible aircraft as jobs, the merge and the sorted
+// queue) at 1 to 16 threads. Only the job recording runs in parallel, so
+// the speed-up is that of the whole frame, serial parts included.
+const int JOB_BENCH_AIRCRAFT = 500;
+const int JOB_BENCH_FRAMES = 20;
+
+void runJobBenchmark() {
+	unsigned int savedThreads = jobSystem().threadCount();
+	glm::vec3 savedCamPos = camPos;
+	float savedYaw = yaw, savedPitch = pitch, savedRoll = roll;
+	createFleet(JOB_BENCH_AIRCRAFT);
+	viewApron();
+	glm::vec3 front(cos(glm::radians(yaw)) * cos(glm::radians(pitch)), sin(glm::radians(pitch)), sin(glm::radians(yaw)) * cos(glm::radians(pitch)));
+	glm::mat4 view = glm::lookAt(camPos, camPos + front, camUp);
+	float farPlane = std::max(150.0f, apronRadius * 2.5f + 50.0f);
+	glm::mat4 proj = glm::perspective(glm::radians(45.0f), (float)framebufferWidth / framebufferHeight, 0.1f, farPlane);
+	partVisible.assign(parts.size(), 1);
+
+	logger().log("Job bench: %d aircraft on the apron, %u hardware threads", JOB_BENCH_AIRCRAFT, std::thread::hardware_concurrency());
+	double singleMs = 0.0;
+	for (unsigned int threads : {1u, 2u, 4u, 8u, 16u}) {
+		jobSystem().setThreadCount(threads);
+		jobSystem().resetStats();
+		submitStats = SubmitStats();
+		size_t jobs = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (int frame = 0; frame < JOB_BENCH_FRAMES; frame++) {
+			frameCounters = FrameCounters();
+			renderQueue.clear();
+			queueFleet(exteriorBatch, view, proj);
+			addFleetJobs();
+			jobs = partJobs.size();
+			recordPartJobs(view, proj);
+			queueInstances(view, false);
+		}
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / JOB_BENCH_FRAMES;
+		if (threads == 1)
+			singleMs = ms;
+		JobSystem::Stats stats = jobSystem().stats();
+		logger().log("Job bench: %u threads, %.2f ms per frame (%.2fx), %.2f ms of it recording jobs, %d aircraft visible, %zu jobs, %zu draws, %.0f%% of jobs stolen",
+			threads, ms, singleMs / ms, submitStats.recordMs / JOB_BENCH_FRAMES, frameCounters.visibleParts, jobs, renderQueue.size(),
+			stats.jobs ? 100.0 * stats.stolen / stats.jobs : 0.0);
+	}
+
+	renderQueue.clear();
+	fleet.clear();
+	fleetLists.clear();
+	aircraftVisible.clear();
+	airportCount = 0;
+	submitStats = SubmitStats();
+	camPos = savedCamPos;
+	yaw = savedYaw;
+	pitch = savedPitch;
+	roll = savedRoll;
+	jobSystem().setThreadCount(savedThreads);
+}
+
+// Everything a frame depends on; in on-demand mode a frame is drawn only
+// when this differs from what is on screen
+struct FrameInputs {
+	glm::mat4 view = glm::mat4(0.0f);
+	float doorAngle = -1.0f;
+	float wheelRotation = 0.0f;
+	bool showInterior = false;
+	bool showCockpit = false;
+	bool lightOn = false;
+	int width = 0;
+	int height = 0;
+
+	bool operator==(const FrameInputs& o) const {
+		return view == o.view && doorAngle == o.doorAngle && wheelRotation == o.wheelRotation &&
+			showInterior == o.showInterior && showCockpit == o.showCockpit && lightOn == o.lightOn &&
+			width == o.width && height == o.height;
+	}
+};
+
+int main(int argc, char** argv) {
+	auto startupBegin = std::chrono::steady_clock::now();
+	bool useMultiDraw = false;
+	bool jobBench = false;
+	bool transformBench = false;
+	int airportAircraft = 0;
+	unsigned int threads = std::max(1u, std::min(16u, std::thread::hardware_concurrency()));
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--on-demand") == 0)
+			framePacer().onDemand = true;
+		else if (strcmp(argv[i], "--multi-draw") == 0)
+			useMultiDraw = true;
+		else if (strcmp(argv[i], "--camera-path") == 0)
+			cameraPath.active = true;
+		else if (strcmp(argv[i], "--no-cull") == 0)
+			cullingEnabled = false;
+		else if (strcmp(argv[i], "--no-occlusion") == 0)
+			occlusionEnabled = false;
+		else if (strcmp(argv[i], "--no-pvs") == 0)
+			pvsEnabled = false;
+		else if (strcmp(argv[i], "--no-sort") == 0)
+			depthSortEnabled = false;
+		else if (strcmp(argv[i], "--depth-prepass") == 0)
+			depthPrepass = true;
+		else if (strcmp(argv[i], "--overdraw") == 0)
+			overdrawView = true;
+		else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+			sceneFilePath = argv[++i];
+		else if (strcmp(argv[i], "--export-scene") == 0 && i + 1 < argc)
+			exportScenePath = argv[++i];
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threads = (unsigned int)std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--job-bench") == 0)
+			jobBench = true;
+		else if (strcmp(argv[i], "--trs-bench") == 0)
+			transformBench = true;
+		else if (strcmp(argv[i], "--airport") == 0 && i + 1 < argc)
+			airportAircraft = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--airport-bench") == 0)
+			airportBench.active = true;
+		else if (strcmp(argv[i], "--no-lights") == 0)
+			clusteredLighting = false;
+		else if (strcmp(argv[i], "--reading-lights") == 0)
+			readingLights = true;
+	}
+	printControls();
+
+	glfwInit();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, useMultiDraw ? 4 : 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_STENCIL_BITS, overdrawView ? 8 : 0);	// only --overdraw counts in the stencil buffer
+	GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, "Realistic Airplane - Cylindrical Design", NULL, NULL);
+	if (window == NULL && useMultiDraw) {
+		// no 4.3 context here; the multi-draw path will fall back
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		window = glfwCreateWindow(WIDTH, HEIGHT, "Realistic Airplane - Cylindrical Design", NULL, NULL);
+	}
+	glfwMakeContextCurrent(window);
+	gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+	framePacer().attach(window);
+	loadGLExtensions((GLADloadproc)glfwGetProcAddress);
+	glEnable(GL_DEPTH_TEST);
+	CameraBuffer cameraBuffer;
+	if (overdrawView) {
+		// every fragment that passes the depth test bumps its pixel's count
+		glState().setBlend(true);
+		glState().setBlendFunc(GL_ONE, GL_ONE);
+		glStencilFunc(GL_ALWAYS, 0, 0xFF);
+		glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+	}
+
+	geometry.create(6 * sizeof(float), 65536, 256 * 1024);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(NORMAL_LOCATION, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+	glEnableVertexAttribArray(NORMAL_LOCATION);
+	primitiveInstances.attachColored(geometry.VAO);
+
+	createCubeMesh();
+	createRoundLods();
+	createDiskMesh();
+	createCabinLights();
+	if (clusteredLighting)
+		lightGrid.create();
+	if (sceneFilePath && openSceneFile(sceneFilePath))
+		loadParts();
+	else
+		surveyParts();
+	buildPartTrees();
+	createOccluders();
+	createCells();
+	bakeExterior();
+	jobSystem().setThreadCount(threads);
+	logger().log("Recording draw lists on %u threads", jobSystem().threadCount());
+	glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+	if (jobBench) {
+		runJobBenchmark();
+		glfwSetWindowShouldClose(window, true);
+	}
+	if (transformBench) {
+		runTransformBenchmark();
+		glfwSetWindowShouldClose(window, true);
+	}
+	if (airportBench.active || airportAircraft > 0) {
+		// the fleet's chunks take their placement from the instance stream
+		primitiveInstances.attachColored(bakedGeometry.VAO);
+		if (airportBench.active) {
+			glfwSwapInterval(0);
+			startAirportStep();
+		} else {
+			createFleet(airportAircraft);
+		}
+	}
+
+	// Cached program binary if there is one, otherwise a background compile.
+	// The draw helpers always rendered fully lit, so that is the variant built;
+	// with clustered lighting the light grid's ambient takes its place.
+	ProgramCache programs;
+	unsigned int variant = SHADER_LIGHT_ON;
+	if (overdrawView)
+		variant |= SHADER_OVERDRAW;
+	else if (clusteredLighting)
+		variant |= SHADER_CLUSTERED;
+	Shader& instancedShader = programs.request("vertex.vs", "fragment.fs", variant | SHADER_INSTANCED);
+	Shader& batchShader = programs.request("vertex.vs", "fragment.fs", variant | SHADER_VERTEX_COLOR);
+
+	// The fragment stage only needs the interpolated colour, which the
+	// INSTANCED variant already takes
+	const Shader* multiDrawShader = nullptr;
+	if (useMultiDraw) {
+		if (glExt().multiDrawIndirect && glExt().shaderDrawParameters)
+			multiDrawShader = &programs.request("vertex_mdi.vs", "fragment.fs", variant | SHADER_INSTANCED);
+		else
+			logger().log("Multi-draw indirect needs GL 4.3 and ARB_shader_draw_parameters, using instanced draws");
+	}
+	const Shader* fleetShader = nullptr;
+	if (airportCount > 0)
+		fleetShader = &programs.request("vertex.vs", "fragment.fs", variant | SHADER_VERTEX_COLOR | SHADER_INSTANCED);
+	const Shader* queuePrograms[PROGRAM_COUNT] = {&batchShader, &instancedShader, multiDrawShader, fleetShader};
+
+	// The depth pre-pass runs the same vertex stages with an empty fragment
+	// stage, so it pays for neither the light loop nor the overdraw count
+	const Shader* prepassPrograms[PROGRAM_COUNT] = {};
+	if (depthPrepass) {
+		unsigned int depthOnly = variant & ~(SHADER_CLUSTERED | SHADER_OVERDRAW);
+		prepassPrograms[PROGRAM_BATCH] = &programs.request("vertex.vs", "depth.fs", depthOnly | SHADER_VERTEX_COLOR);
+		prepassPrograms[PROGRAM_INSTANCED] = &programs.request("vertex.vs", "depth.fs", depthOnly | SHADER_INSTANCED);
+		if (multiDrawShader)
+			prepassPrograms[PROGRAM_MULTI_DRAW] = &programs.request("vertex_mdi.vs", "depth.fs", depthOnly | SHADER_INSTANCED);
+		if (fleetShader)
+			prepassPrograms[PROGRAM_FLEET] = &programs.request("vertex.vs", "depth.fs", depthOnly | SHADER_VERTEX_COLOR | SHADER_INSTANCED);
+	}
+	bool firstFrameDrawn = false;
+	FrameInputs shown;
 
 	float lastT = 0.0f;
 
@@ -956,10 +2626,18 @@ int main() {
 		float dt = now - lastT;
 		lastT = now;
 		processInput(window, dt);
-
-		glClearColor(0.55f, 0.82f, 0.95f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glUseProgram(shader);
+		if (cameraPath.active)
+			advanceCameraPath();
+
+		// Sky only until the program has finished compiling
+		if (programs.poll() > 0) {
+			glClearColor(0.55f, 0.82f, 0.95f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			glfwSwapBuffers(window);
+			framePacer().requestRedraw();
+			lastT += (float)framePacer().waitEvents();
+			continue;
+		}
 
 		glm::vec3 f;
 		f.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
@@ -969,65 +2647,117 @@ int main() {
 
 		glm::mat4 view = glm::lookAt(camPos, camPos + camFront, camUp);
 		view = glm::rotate(view, glm::radians(roll), camFront);
-		glm::mat4 proj = glm::perspective(glm::radians(45.0f), (float)WIDTH / HEIGHT, 0.1f, 150.0f);
-
-		// Ground & Runway (only when not in cockpit/interior view)
-		if (!showCockpit && !showInterior) {
-			drawCube(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0, -2.0f, 0)), glm::vec3(120, 0.1f, 120)),
-				view, proj, glm::vec3(0.35f, 0.38f, 0.35f));
-
-			drawCube(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0, -1.95f, 0)), glm::vec3(80, 0.02f, 8)),
-				view, proj, glm::vec3(0.25f, 0.25f, 0.28f));
-
-			for (int i = -12; i < 12; i++) {
-				drawCube(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(i * 2.8f, -1.93f, 0)), glm::vec3(1.8f, 0.01f, 0.3f)),
-					view, proj, glm::vec3(0.95f, 0.95f, 0.1f));
-			}
+		float farPlane = airportCount > 0 ? std::max(150.0f, apronRadius * 2.5f + 50.0f) : 150.0f;
+		glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+		if (framebufferWidth == 0 || framebufferHeight == 0) {
+			glfwWaitEvents();	// minimised: nothing to draw until it is restored
+			lastT = (float)glfwGetTime();
+			continue;
 		}
-
-		// Draw exterior (not in interior/cockpit mode)
-		if (!showInterior && !showCockpit) {
-			drawFuselage(view, proj);
-			drawWindows(view, proj);
-			drawCockpit(view, proj);
-			drawDoor(view, proj);
-			drawEmergencyExits(view, proj);
-			drawWings(view, proj);
-			drawTailWings(view, proj);
-			drawVerticalStabilizer(view, proj);
-			drawEngines(view, proj);
-			drawLandingGear(view, proj);
+		glm::mat4 proj = glm::perspective(glm::radians(45.0f), (float)framebufferWidth / framebufferHeight, 0.1f, farPlane);
+
+		FrameInputs inputs;
+		inputs.view = view;
+		inputs.doorAngle = doorAngle;
+		inputs.wheelRotation = wheelRotation;
+		inputs.showInterior = showInterior;
+		inputs.showCockpit = showCockpit;
+		inputs.lightOn = lightOn;
+		inputs.width = framebufferWidth;
+		inputs.height = framebufferHeight;
+		if (!(inputs == shown))
+			framePacer().requestRedraw();
+		if (!framePacer().beginFrame()) {
+			framePacer().report();
+			lastT += (float)framePacer().waitEvents();
+			continue;
+		}
+		shown = inputs;
+		glViewport(0, 0, framebufferWidth, framebufferHeight);
+		frameCounters = FrameCounters();
+		bool interior = showInterior || showCockpit;
+		Scene scene = showCockpit ? SCENE_COCKPIT : showInterior ? SCENE_CABIN : SCENE_EXTERIOR;
+		if (!interior && airportCount > 0)
+			partVisible.assign(parts.size(), 1);
+		else
+			cullScene(scene, proj * view);
+
+		if (overdrawView)
+			glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+		else
+			glClearColor(0.55f, 0.82f, 0.95f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | (overdrawView ? GL_STENCIL_BUFFER_BIT : 0));
+
+		// Exterior, ground & runway (not in interior/cockpit mode): the baked
+		// static part in one draw, then the animated door and wheels
+		renderQueue.clear();
+		if (!interior && airportCount > 0) {
+			queueFleet(exteriorBatch, view, proj);
+			addFleetJobs();
+		} else if (!interior) {
+			queueStaticBatch(exteriorBatch, view, proj);
+			addPartJobs(LIVE_EXTERIOR, liveExteriorLists);
 		}
 
-		// Draw cabin interior
-		if (showInterior) {
-			drawCabinFloor(view, proj);
-			drawAisle(view, proj);
-			drawCabinSeats(view, proj);
-			drawOverheadCompartments(view, proj);
-			drawCabinCeiling(view, proj);
-			drawGalley(view, proj);
-			drawLavatory(view, proj);
+		// Cabin or cockpit interior, narrowed by the PVS to what the
+		// camera's cell can see
+		if (scene == SCENE_CABIN)
+			addPartJobs(CABIN_PARTS, cabinLists);
+		else if (scene == SCENE_COCKPIT)
+			addPartJobs(COCKPIT_PARTS, cockpitLists);
+		recordPartJobs(view, proj);
+
+		// Everything above only queued draws; sort and submit them
+		queueInstances(view, multiDrawShader != nullptr);
+		cameraBuffer.update(proj, view);
+		if (clusteredLighting)
+			updateLights(window, view, proj, interior);
+		if (depthPrepass) {
+			glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+			replayQueue(prepassPrograms, true);
+			glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+			glState().setDepthFunc(GL_EQUAL);
+			glState().setDepthMask(false);
 		}
-		
-		// Draw cockpit interior
-		if (showCockpit) {
-			drawCockpitInterior(view, proj);
+		if (overdrawView)
+			glEnable(GL_STENCIL_TEST);
+		replayQueue(queuePrograms);
+		if (overdrawView) {
+			glDisable(GL_STENCIL_TEST);
+			measureOverdraw(window);
+		}
+		if (depthPrepass) {
+			// glClear honours the depth mask
+			glState().setDepthFunc(GL_LESS);
+			glState().setDepthMask(true);
+		}
+		reportSubmitStats(multiDrawShader != nullptr);
+		if (cameraPath.active && !recordCameraPath())
+			glfwSetWindowShouldClose(window, true);
+		if (airportBench.active) {
+			if (!recordAirportBench())
+				glfwSetWindowShouldClose(window, true);
+			framePacer().requestRedraw();
 		}
 
+		framePacer().report();
 		glfwSwapBuffers(window);
-		glfwPollEvents();
-	}
-
-	glDeleteVertexArrays(1, &cubeVAO);
-	glDeleteBuffers(1, &cubeVBO);
-	glDeleteVertexArrays(1, &cylinderVAO);
-	glDeleteBuffers(1, &cylinderVBO);
-	glDeleteVertexArrays(1, &coneVAO);
-	glDeleteBuffers(1, &coneVBO);
-	glDeleteVertexArrays(1, &diskVAO);
-	glDeleteBuffers(1, &diskVBO);
-	glDeleteProgram(shader);
+		lastT += (float)framePacer().waitEvents();
+
+		if (!firstFrameDrawn) {
+			double startupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupBegin).count();
+			logger().log("Startup: first complete frame after %g ms (%d from binary cache, %d compiled)",
+				startupMs, programs.stats.fromBinary, programs.stats.compiled);
+			firstFrameDrawn = true;
+		}
+	}
+
+	geometry.release();
+	bakedGeometry.release();
+	multiDraw.release();
+	if (clusteredLighting)
+		lightGrid.release();
+	programs.release();
 
 	glfwTerminate();
 	return 0;
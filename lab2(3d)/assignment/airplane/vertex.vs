@@ -1,10 +1,59 @@
 ﻿#version 330 core
 layout (location = 0) in vec3 aPos;
+#ifdef VERTEX_COLOR
+layout (location = 1) in vec3 aColor;
+#endif
+#ifdef INSTANCED
+layout (location = 2) in mat4 aModel;
+layout (location = 6) in vec4 aInstanceColor;
+#endif
+#ifdef CLUSTERED_LIGHTS
+layout (location = 7) in vec3 aNormal;
+#ifdef INSTANCED
+layout (location = 8) in mat3 aNormalMatrix;
+#endif
+out vec3 viewPosition;
+out vec3 viewNormal;
+#endif
+#if defined(VERTEX_COLOR) || defined(INSTANCED)
+out vec3 vertexColor;
+#endif
 
+// baked (VERTEX_COLOR) vertices are already in world space, or in the
+// aircraft's own when instanced across the airport apron
+#if !defined(INSTANCED) && !defined(VERTEX_COLOR)
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#ifdef CLUSTERED_LIGHTS
+uniform mat3 normalMatrix;
+#endif
+#endif
+#include "../../practise1/camera.glsl"
+
+// the depth pre-pass and the GL_EQUAL pass must produce identical depths
+invariant gl_Position;
 
 void main() {
+#ifdef INSTANCED
+    mat4 model = aModel;
+#elif defined(VERTEX_COLOR)
+    const mat4 model = mat4(1.0);
+#endif
     gl_Position = projection * view * model * vec4(aPos, 1.0);
+#ifdef CLUSTERED_LIGHTS
+    // the parts are scaled unevenly, so normals take the inverse transpose
+    // of the model matrix, worked out on the CPU per instance; the
+    // view only rotates and applies as it is
+#ifdef INSTANCED
+    mat3 normalMatrix = aNormalMatrix;
+#elif defined(VERTEX_COLOR)
+    const mat3 normalMatrix = mat3(1.0);
+#endif
+    viewPosition = vec3(view * model * vec4(aPos, 1.0));
+    viewNormal = mat3(view) * (normalMatrix * aNormal);
+#endif
+#ifdef VERTEX_COLOR
+    vertexColor = aColor;
+#elif defined(INSTANCED)
+    vertexColor = aInstanceColor.rgb;
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,35 @@
+﻿#version 430 core
+#extension GL_ARB_shader_draw_parameters : require
+// Multi-draw indirect variant of vertex.vs: every command draws one
+// primitive and finds its model matrix and colour by gl_DrawIDARB.
+layout (location = 0) in vec3 aPos;
+#ifdef CLUSTERED_LIGHTS
+layout (location = 7) in vec3 aNormal;
+out vec3 viewPosition;
+out vec3 viewNormal;
+#endif
+
+struct DrawData {
+    mat4 model;
+    vec4 color;
+    mat3 normalMatrix;
+};
+
+layout (std430, binding = 0) readonly buffer DrawDataBuffer {
+    DrawData draws[];
+};
+
+#include "../../practise1/camera.glsl"
+
+out vec3 vertexColor;
+invariant gl_Position;
+
+void main() {
+    DrawData draw = draws[gl_DrawIDARB];
+    gl_Position = projection * view * draw.model * vec4(aPos, 1.0);
+#ifdef CLUSTERED_LIGHTS
+    viewPosition = vec3(view * draw.model * vec4(aPos, 1.0));
+    viewNormal = mat3(view) * (draw.normalMatrix * aNormal);
+#endif
+    vertexColor = draw.color.rgb;
+}
\ No newline at end of file
@@ -0,0 +1,349 @@
+//
+//  async_logger.h
+//  3D Object Drawing
+//
+
+#ifndef ASYNC_LOGGER_H
+#define ASYNC_LOGGER_H
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+
+// Console output that never blocks the caller. log() copies the format
+// pointer and the raw arguments into a fixed-size ring (a bounded
+// multi-producer, single-consumer queue with a sequence number per cell);
+// a background thread formats the records and writes them to stdout. When
+// the ring is full the record is dropped and counted instead of waiting,
+// and the writer reports the count. The destructor drains the ring before
+// the thread exits, so everything logged before exit gets printed. An idle
+// writer sleeps on a condition variable; log() only takes the mutex to
+// wake it when it is actually asleep.
+//
+// The format is printf-style and must outlive the record (use a literal).
+// Numbers are stored as long long or double and any length modifier in the
+// format is ignored; strings are copied into the record, up to TEXT_SIZE
+// bytes in total.
+class AsyncLogger
+{
+public:
+    static const size_t CAPACITY = 1024;    // records, a power of two
+    static const int MAX_ARGS = 8;
+    static const size_t TEXT_SIZE = 64;
+
+    AsyncLogger()
+    {
+        for (size_t i = 0; i < CAPACITY; i++)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        writer = std::thread(&AsyncLogger::run, this);
+    }
+
+    ~AsyncLogger()
+    {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            stopping.store(true, std::memory_order_release);
+        }
+        wake.notify_one();
+        writer.join();
+    }
+
+    AsyncLogger(const AsyncLogger&) = delete;
+    AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+    // Returns false when the record was dropped because the ring is full.
+    template<typename... Args>
+    bool log(const char* format, Args... args)
+    {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;)
+        {
+            cell = &cells[pos & (CAPACITY - 1)];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0)
+            {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        Record& record = cell->record;
+        record.format = format;
+        record.argCount = 0;
+        record.textUsed = 0;
+        pack(record, args...);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+
+        // pairs with the fence in waitForRecords(): either the writer sees
+        // this record before sleeping or this sees it asleep
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            wake.notify_one();
+        }
+        return true;
+    }
+
+    // Blocks until everything logged so far has been written.
+    void flush()
+    {
+        size_t target = enqueuePos.load(std::memory_order_acquire);
+        while (written.load(std::memory_order_acquire) < target)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    unsigned long long droppedCount() const
+    {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Arg
+    {
+        enum Kind : unsigned char { INTEGER, REAL, TEXT } kind;
+        union
+        {
+            long long i;
+            double d;
+            unsigned int textOffset;
+        };
+    };
+
+    struct Record
+    {
+        const char* format;
+        int argCount;
+        unsigned int textUsed;
+        Arg args[MAX_ARGS];
+        char text[TEXT_SIZE];
+    };
+
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        Record record;
+    };
+
+    Cell cells[CAPACITY];
+    // producers and the writer touch these constantly, keep them apart
+    alignas(64) std::atomic<size_t> enqueuePos{ 0 };
+    alignas(64) std::atomic<size_t> written{ 0 };
+    std::atomic<unsigned long long> dropped{ 0 };
+    std::atomic<bool> stopping{ false };
+    std::atomic<bool> sleeping{ false };
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::thread writer;
+
+    static void pack(Record&) {}
+
+    template<typename T, typename... Rest>
+    static void pack(Record& record, T value, Rest... rest)
+    {
+        if (record.argCount < MAX_ARGS)
+            store(record, record.args[record.argCount++], value);
+        pack(record, rest...);
+    }
+
+    template<typename T>
+    static typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type
+        store(Record&, Arg& arg, T value)
+    {
+        arg.kind = Arg::INTEGER;
+        arg.i = (long long)value;
+    }
+
+    template<typename T>
+    static typename std::enable_if<std::is_floating_point<T>::value>::type
+        store(Record&, Arg& arg, T value)
+    {
+        arg.kind = Arg::REAL;
+        arg.d = value;
+    }
+
+    static void store(Record& record, Arg& arg, const char* value)
+    {
+        arg.kind = Arg::TEXT;
+        arg.textOffset = record.textUsed;
+        size_t room = TEXT_SIZE - record.textUsed;
+        if (room == 0)
+        {
+            arg.textOffset = TEXT_SIZE - 1;  // the terminator of the last string
+            return;
+        }
+        size_t length = strlen(value);
+        if (length >= room)
+            length = room - 1;
+        memcpy(record.text + record.textUsed, value, length);
+        record.text[record.textUsed + length] = '\0';
+        record.textUsed += (unsigned int)length + 1;
+    }
+
+    static void store(Record& record, Arg& arg, const std::string& value)
+    {
+        store(record, arg, value.c_str());
+    }
+
+    // printf for a stored record: every conversion is re-issued with the
+    // argument's stored type
+    static void format(const Record& record, std::string& out)
+    {
+        char buffer[128];
+        char spec[32];
+        int next = 0;
+        for (const char* p = record.format; *p; p++)
+        {
+            if (*p != '%')
+            {
+                out += *p;
+                continue;
+            }
+            if (p[1] == '%')
+            {
+                out += '%';
+                p++;
+                continue;
+            }
+
+            size_t specLength = 0;
+            spec[specLength++] = '%';
+            const char* q = p + 1;
+            while (*q && strchr("-+ #0123456789.", *q) && specLength < sizeof(spec) - 4)
+                spec[specLength++] = *q++;
+            while (*q && strchr("hlLqjzt", *q))
+                q++;
+            char conversion = *q;
+            if (!conversion)
+                break;
+            p = q;
+
+            if (next >= record.argCount)
+            {
+                out += "<?>";
+                continue;
+            }
+            const Arg& arg = record.args[next++];
+            int length = 0;
+            if (conversion == 's')
+            {
+                spec[specLength++] = 's';
+                spec[specLength] = '\0';
+                length = snprintf(buffer, sizeof(buffer), spec, arg.kind == Arg::TEXT ? record.text + arg.textOffset : "<?>");
+            }
+            else if (strchr("fFeEgGaA", conversion))
+            {
+                spec[specLength++] = conversion;
+                spec[specLength] = '\0';
+                length = snprintf(buffer, sizeof(buffer), spec, arg.kind == Arg::REAL ? arg.d : (double)arg.i);
+            }
+            else if (strchr("diouxXc", conversion))
+            {
+                if (conversion != 'c')
+                {
+                    spec[specLength++] = 'l';
+                    spec[specLength++] = 'l';
+                }
+                spec[specLength++] = conversion;
+                spec[specLength] = '\0';
+                long long value = arg.kind == Arg::REAL ? (long long)arg.d : arg.i;
+                if (conversion == 'c')
+                    length = snprintf(buffer, sizeof(buffer), spec, (int)value);
+                else
+                    length = snprintf(buffer, sizeof(buffer), spec, value);
+            }
+            else
+            {
+                out += "<?>";
+                continue;
+            }
+            if (length > 0)
+                out.append(buffer, (size_t)length < sizeof(buffer) ? (size_t)length : sizeof(buffer) - 1);
+        }
+        out += '\n';
+    }
+
+    void run()
+    {
+        size_t dequeuePos = 0;
+        unsigned long long reportedDrops = 0;
+        std::string batch;
+        for (;;)
+        {
+            // read the flag first: once it is set, an empty ring stays empty
+            bool stop = stopping.load(std::memory_order_acquire);
+
+            batch.clear();
+            for (;;)
+            {
+                Cell& cell = cells[dequeuePos & (CAPACITY - 1)];
+                if (cell.sequence.load(std::memory_order_acquire) != dequeuePos + 1)
+                    break;
+                format(cell.record, batch);
+                cell.sequence.store(dequeuePos + CAPACITY, std::memory_order_release);
+                dequeuePos++;
+            }
+
+            unsigned long long drops = dropped.load(std::memory_order_relaxed);
+            if (drops != reportedDrops)
+            {
+                batch += "[log] " + std::to_string(drops - reportedDrops) + " records dropped, the ring was full\n";
+                reportedDrops = drops;
+            }
+
+            if (!batch.empty())
+            {
+                fwrite(batch.data(), 1, batch.size(), stdout);
+                fflush(stdout);
+            }
+            written.store(dequeuePos, std::memory_order_release);
+
+            if (stop)
+                return;
+            if (batch.empty())
+                waitForRecords(dequeuePos, reportedDrops);
+        }
+    }
+
+    // Sleeps until the next record is published, a drop happens or the
+    // logger is stopping
+    void waitForRecords(size_t dequeuePos, unsigned long long reportedDrops)
+    {
+        const Cell& next = cells[dequeuePos & (CAPACITY - 1)];
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        wake.wait(lock, [&] {
+            return stopping.load(std::memory_order_acquire) ||
+                next.sequence.load(std::memory_order_acquire) == dequeuePos + 1 ||
+                dropped.load(std::memory_order_relaxed) != reportedDrops;
+        });
+        sleeping.store(false, std::memory_order_relaxed);
+    }
+};
+
+inline AsyncLogger& logger()
+{
+    static AsyncLogger instance;
+    return instance;
+}
+
+#endif
@@ -0,0 +1,242 @@
+//
+//  bvh.h
+//  3D Object Drawing
+//
+
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BVH_SSE 1
+#include <emmintrin.h>
+#endif
+
+struct AABB
+{
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    bool empty() const
+    {
+        return min.x > max.x;
+    }
+
+    void expand(const AABB& other)
+    {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    glm::vec3 center() const
+    {
+        return (min + max) * 0.5f;
+    }
+
+    glm::vec3 extent() const
+    {
+        return (max - min) * 0.5f;
+    }
+};
+
+// The six planes of a view-projection matrix (Gribb & Hartmann), normals
+// pointing inwards. They are stored as four arrays of eight, the last two
+// planes never rejecting anything, so a box is tested against four planes
+// per SSE instruction.
+struct Frustum
+{
+    enum Result { OUTSIDE, INTERSECTS, INSIDE };
+
+    alignas(16) float nx[8];
+    alignas(16) float ny[8];
+    alignas(16) float nz[8];
+    alignas(16) float d[8];
+
+    explicit Frustum(const glm::mat4& viewProj)
+    {
+        // glm is column-major: row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+        glm::vec4 planes[6] = {
+            rows[3] + rows[0], rows[3] - rows[0],   // left, right
+            rows[3] + rows[1], rows[3] - rows[1],   // bottom, top
+            rows[3] + rows[2], rows[3] - rows[2]    // near, far
+        };
+        for (int i = 0; i < 6; i++)
+        {
+            float length = glm::length(glm::vec3(planes[i]));
+            nx[i] = planes[i].x / length;
+            ny[i] = planes[i].y / length;
+            nz[i] = planes[i].z / length;
+            d[i] = planes[i].w / length;
+        }
+        for (int i = 6; i < 8; i++)
+        {
+            nx[i] = ny[i] = nz[i] = 0.0f;
+            d[i] = FLT_MAX;
+        }
+    }
+
+    // Signed distance of the box centre against its projected radius on
+    // each normal: outside a single plane rejects the box, inside all of
+    // them accepts everything under it.
+    Result classify(const AABB& box) const
+    {
+        glm::vec3 c = box.center();
+        glm::vec3 e = box.extent();
+#ifdef BVH_SSE
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        __m128 cx = _mm_set1_ps(c.x), cy = _mm_set1_ps(c.y), cz = _mm_set1_ps(c.z);
+        __m128 ex = _mm_set1_ps(e.x), ey = _mm_set1_ps(e.y), ez = _mm_set1_ps(e.z);
+        bool inside = true;
+        for (int i = 0; i < 8; i += 4)
+        {
+            __m128 px = _mm_load_ps(nx + i), py = _mm_load_ps(ny + i), pz = _mm_load_ps(nz + i);
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, cx), _mm_mul_ps(py, cy)),
+                _mm_add_ps(_mm_mul_ps(pz, cz), _mm_load_ps(d + i)));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_and_ps(px, absMask), ex),
+                _mm_mul_ps(_mm_and_ps(py, absMask), ey)), _mm_mul_ps(_mm_and_ps(pz, absMask), ez));
+            if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), zero)))
+                return OUTSIDE;
+            if (_mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance, radius), zero)))
+                inside = false;
+        }
+        return inside ? INSIDE : INTERSECTS;
+#else
+        bool inside = true;
+        for (int i = 0; i < 6; i++)
+        {
+            float distance = nx[i] * c.x + ny[i] * c.y + nz[i] * c.z + d[i];
+            float radius = std::fabs(nx[i]) * e.x + std::fabs(ny[i]) * e.y + std::fabs(nz[i]) * e.z;
+            if (distance + radius < 0.0f)
+                return OUTSIDE;
+            if (distance - radius < 0.0f)
+                inside = false;
+        }
+        return inside ? INSIDE : INTERSECTS;
+#endif
+    }
+};
+
+// Binary tree over a fixed set of boxes, built once by splitting at the
+// median centre along the longest axis. Culling walks it top-down: a node
+// outside the frustum drops its whole subtree, a node fully inside accepts
+// its whole subtree without testing further.
+class BVH
+{
+public:
+    struct Stats
+    {
+        int visible = 0;
+        int culled = 0;
+        int nodesTested = 0;
+    };
+
+    void build(const std::vector<AABB>& boxes)
+    {
+        leafCount = (int)boxes.size();
+        nodes.clear();
+        order.resize(boxes.size());
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = (int)i;
+        if (!boxes.empty())
+        {
+            nodes.reserve(boxes.size() * 2);
+            nodes.resize(1);
+            buildNode(boxes, 0, 0, (int)boxes.size());
+        }
+    }
+
+    // visible[i] is set to 1 for every box that may intersect the frustum
+    // and to 0 for the rest.
+    Stats cull(const Frustum& frustum, std::vector<unsigned char>& visible) const
+    {
+        Stats stats;
+        visible.assign(leafCount, 0);
+        if (nodes.empty())
+            return stats;
+
+        int stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const Node& node = nodes[stack[--top]];
+            stats.nodesTested++;
+            Frustum::Result result = frustum.classify(node.bounds);
+            if (result == Frustum::OUTSIDE)
+                continue;
+            if (result == Frustum::INSIDE || node.count == 1)
+            {
+                for (int i = node.first; i < node.first + node.count; i++)
+                    visible[order[i]] = 1;
+                continue;
+            }
+            stack[top++] = node.left;
+            stack[top++] = node.left + 1;
+        }
+
+        for (unsigned char v : visible)
+        {
+            if (v) stats.visible++; else stats.culled++;
+        }
+        return stats;
+    }
+
+private:
+    // leaves of a subtree are order[first .. first + count)
+    struct Node
+    {
+        AABB bounds;
+        int first;
+        int count;
+        int left;   // the right child is left + 1
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> order;
+    int leafCount = 0;
+
+    // fills nodes[index]; children are appended as a pair, so only the
+    // left index is kept
+    void buildNode(const std::vector<AABB>& boxes, int index, int first, int count)
+    {
+        AABB bounds, centers;
+        for (int i = first; i < first + count; i++)
+        {
+            const AABB& box = boxes[order[i]];
+            bounds.expand(box);
+            AABB point;
+            point.min = point.max = box.center();
+            centers.expand(point);
+        }
+        nodes[index].bounds = bounds;
+        nodes[index].first = first;
+        nodes[index].count = count;
+        nodes[index].left = -1;
+        if (count == 1)
+            return;
+
+        glm::vec3 size = centers.max - centers.min;
+        int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+        int half = count / 2;
+        std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+            [&](int a, int b) { return boxes[a].center()[axis] < boxes[b].center()[axis]; });
+
+        int left = (int)nodes.size();
+        nodes.resize(nodes.size() + 2);
+        nodes[index].left = left;
+        buildNode(boxes, left, first, half);
+        buildNode(boxes, left + 1, first + half, count - half);
+    }
+};
+
+#endif
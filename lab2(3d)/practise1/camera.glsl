@@ -0,0 +1,6 @@
+// Shared by every program; Shader binds it to CAMERA_BLOCK_BINDING on link.
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+};
@@ -0,0 +1,49 @@
+//
+//  camera_buffer.h
+//  3D Object Drawing
+//
+
+#ifndef CAMERA_BUFFER_H
+#define CAMERA_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "gl_state.h"
+
+// std140 mirror of the Camera block in vertexShader.vs. Two mat4s need no
+// padding, so the C++ layout matches the GLSL one byte for byte.
+struct CameraData
+{
+    glm::mat4 projection;
+    glm::mat4 view;
+};
+
+// Uniform buffer behind the Camera block. It is written once per frame and
+// stays bound at CAMERA_BLOCK_BINDING, so every program that links against
+// the block sees the same matrices without a program switch.
+class CameraBuffer
+{
+public:
+    unsigned int ID;
+
+    CameraBuffer()
+    {
+        glGenBuffers(1, &ID);
+        glState().bindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraData), NULL, GL_DYNAMIC_DRAW);
+        glState().bindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, ID);
+    }
+
+    void update(const glm::mat4& projection, const glm::mat4& view)
+    {
+        CameraData data;
+        data.projection = projection;
+        data.view = view;
+        glState().bindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraData), &data);
+    }
+};
+
+#endif
@@ -0,0 +1,37 @@
+// Shared by every CLUSTERED_LIGHTS program; Shader binds the block to
+// LIGHT_GRID_BLOCK_BINDING and the samplers to their units on link, and
+// LightGridBuffer in clustered_lights.h fills all four.
+layout (std140) uniform LightGrid
+{
+    vec4 ambient;
+    ivec4 gridSize;         // tiles across, tiles up, slices, lights
+    vec4 clusterScale;      // tiles per pixel across and up, slice scale and bias
+};
+
+uniform samplerBuffer lightData;        // per light: view position and radius, colour
+uniform usamplerBuffer clusterRanges;   // per cluster: first index, count
+uniform usamplerBuffer lightIndices;
+
+// Ambient plus the diffuse light of the lights in this fragment's cluster.
+// position and normal are in view space.
+vec3 clusteredLight(vec3 position, vec3 normal)
+{
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy * clusterScale.xy), ivec2(0), gridSize.xy - 1);
+    int slice = clamp(int(floor(log(-position.z) * clusterScale.z + clusterScale.w)), 0, gridSize.z - 1);
+    uvec2 range = texelFetch(clusterRanges, (slice * gridSize.y + tile.y) * gridSize.x + tile.x).xy;
+
+    vec3 light = ambient.rgb;
+    for (uint i = 0u; i < range.y; i++) {
+        int index = int(texelFetch(lightIndices, int(range.x + i)).r);
+        vec4 sphere = texelFetch(lightData, index * 2);
+        vec3 color = texelFetch(lightData, index * 2 + 1).rgb;
+
+        // inverse square, windowed to reach zero at the radius
+        vec3 toLight = sphere.xyz - position;
+        float distance2 = max(dot(toLight, toLight), 1e-4);
+        float window = clamp(1.0 - distance2 / (sphere.w * sphere.w), 0.0, 1.0);
+        float attenuation = window * window / (1.0 + distance2);
+        light += color * attenuation * max(dot(normal, toLight * inversesqrt(distance2)), 0.0);
+    }
+    return light;
+}
@@ -0,0 +1,338 @@
+//
+//  clustered_lights.h
+//  3D Object Drawing
+//
+
+#ifndef CLUSTERED_LIGHTS_H
+#define CLUSTERED_LIGHTS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "gl_state.h"
+
+#include <vector>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+// A point light in world space; it reaches nothing beyond `radius`
+struct PointLight
+{
+    glm::vec3 position;
+    float radius;
+    glm::vec3 color;
+};
+
+// Clustered forward shading, after "Clustered Deferred and Forward Shading"
+// (Olsson, Billeter, Assarsson 2012). The view frustum is cut into
+// GRID_X x GRID_Y screen tiles and GRID_Z depth slices that grow
+// exponentially with distance, and every light is binned on the CPU into
+// the clusters its sphere touches. A fragment then finds its cluster from
+// gl_FragCoord and its depth and loops over that cluster's lights only, so
+// the cost per pixel follows the lights nearby, not the lights in the scene.
+//
+// build() leaves three flat arrays, uploaded by LightGridBuffer:
+//   lightTexels    two vec4 per light that reached a cluster: view-space
+//                  position and radius, colour
+//   ranges         first index and count per cluster, x fastest, then y, z
+//   indices        the lights of every cluster, cluster after cluster
+class LightClusters
+{
+public:
+    static const int GRID_X = 16;
+    static const int GRID_Y = 9;
+    static const int GRID_Z = 24;
+    static const int CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+    static const size_t MAX_LIGHTS = 65536;     // indices are uint16
+
+    struct Stats
+    {
+        int lights = 0;             // passed to build()
+        int visible = 0;            // reached at least one cluster
+        int occupiedClusters = 0;
+        int maxPerCluster = 0;
+        size_t references = 0;      // entries in the index list
+        double buildMs = 0.0;
+    };
+    Stats stats;
+
+    std::vector<glm::vec4> lightTexels;
+    std::vector<uint32_t> ranges;
+    std::vector<uint16_t> indices;
+
+    float sliceScale = 0.0f;        // slice = log(depth) * sliceScale + sliceBias
+    float sliceBias = 0.0f;
+
+    // `projection` has to be a symmetric perspective such as glm::perspective
+    // makes; its near and far planes bound the slices.
+    void build(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection)
+    {
+        auto start = std::chrono::steady_clock::now();
+        setFrustum(projection);
+        stats = Stats();
+        stats.lights = (int)lights.size();
+        lightTexels.clear();
+        indices.clear();
+        ranges.assign(CLUSTER_COUNT * 2, 0);
+        pairs.clear();
+
+        for (const PointLight& light : lights)
+        {
+            if (lightTexels.size() / 2 >= MAX_LIGHTS)
+                break;
+            glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+            if (!binLight(center, light.radius, (uint32_t)(lightTexels.size() / 2)))
+                continue;
+            lightTexels.push_back(glm::vec4(center, light.radius));
+            lightTexels.push_back(glm::vec4(light.color, 1.0f));
+        }
+        stats.visible = (int)(lightTexels.size() / 2);
+
+        // counting sort of the (cluster, light) pairs by cluster
+        for (const ClusterLight& pair : pairs)
+            ranges[pair.cluster * 2 + 1]++;
+        uint32_t offset = 0;
+        for (int c = 0; c < CLUSTER_COUNT; c++)
+        {
+            uint32_t count = ranges[c * 2 + 1];
+            ranges[c * 2] = offset;
+            offset += count;
+            if (count > 0)
+                stats.occupiedClusters++;
+            stats.maxPerCluster = std::max(stats.maxPerCluster, (int)count);
+        }
+        indices.resize(pairs.size());
+        fill.assign(CLUSTER_COUNT, 0);
+        for (const ClusterLight& pair : pairs)
+            indices[ranges[pair.cluster * 2] + fill[pair.cluster]++] = (uint16_t)pair.light;
+        stats.references = indices.size();
+        stats.buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    struct ClusterLight
+    {
+        uint32_t cluster;
+        uint32_t light;
+    };
+
+    std::vector<ClusterLight> pairs;
+    std::vector<uint32_t> fill;
+
+    // view-space bounds of every cluster, rebuilt when the frustum changes
+    glm::vec3 boundsMin[CLUSTER_COUNT];
+    glm::vec3 boundsMax[CLUSTER_COUNT];
+    float nearPlane = 0.0f, farPlane = 0.0f;
+    float tanHalfX = 0.0f, tanHalfY = 0.0f;
+    float sliceDepth[GRID_Z + 1];
+
+    void setFrustum(const glm::mat4& projection)
+    {
+        float n = projection[3][2] / (projection[2][2] - 1.0f);
+        float f = projection[3][2] / (projection[2][2] + 1.0f);
+        float tx = 1.0f / projection[0][0], ty = 1.0f / projection[1][1];
+        if (n == nearPlane && f == farPlane && tx == tanHalfX && ty == tanHalfY)
+            return;
+        nearPlane = n;
+        farPlane = f;
+        tanHalfX = tx;
+        tanHalfY = ty;
+        sliceScale = GRID_Z / std::log(f / n);
+        sliceBias = -std::log(n) * sliceScale;
+        for (int z = 0; z <= GRID_Z; z++)
+            sliceDepth[z] = n * std::pow(f / n, (float)z / GRID_Z);
+
+        for (int z = 0; z < GRID_Z; z++)
+        {
+            for (int y = 0; y < GRID_Y; y++)
+            {
+                for (int x = 0; x < GRID_X; x++)
+                {
+                    // the tile's NDC rectangle at the slice's near and far depth
+                    float x0 = -1.0f + 2.0f * x / GRID_X, x1 = -1.0f + 2.0f * (x + 1) / GRID_X;
+                    float y0 = -1.0f + 2.0f * y / GRID_Y, y1 = -1.0f + 2.0f * (y + 1) / GRID_Y;
+                    glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+                    for (float depth : {sliceDepth[z], sliceDepth[z + 1]})
+                    {
+                        for (float ndcX : {x0, x1})
+                        {
+                            for (float ndcY : {y0, y1})
+                            {
+                                glm::vec3 corner(ndcX * depth * tanHalfX, ndcY * depth * tanHalfY, -depth);
+                                low = glm::min(low, corner);
+                                high = glm::max(high, corner);
+                            }
+                        }
+                    }
+                    int c = clusterIndex(x, y, z);
+                    boundsMin[c] = low;
+                    boundsMax[c] = high;
+                }
+            }
+        }
+    }
+
+    static int clusterIndex(int x, int y, int z)
+    {
+        return (z * GRID_Y + y) * GRID_X + x;
+    }
+
+    int sliceOf(float depth) const
+    {
+        return std::min(GRID_Z - 1, std::max(0, (int)std::floor(std::log(depth) * sliceScale + sliceBias)));
+    }
+
+    // Tile column or row for an NDC coordinate
+    static int tileOf(float ndc, int tiles)
+    {
+        return std::min(tiles - 1, std::max(0, (int)std::floor((ndc * 0.5f + 0.5f) * tiles)));
+    }
+
+    // Adds the light to every cluster its sphere touches; false if none
+    bool binLight(const glm::vec3& center, float radius, uint32_t light)
+    {
+        float nearest = -center.z - radius, farthest = -center.z + radius;
+        if (farthest < nearPlane || nearest > farPlane)
+            return false;
+        nearest = std::max(nearest, nearPlane);
+        farthest = std::min(farthest, farPlane);
+
+        // x / depth is monotonic in depth, so the sphere's bounding box
+        // reaches its extreme NDC coordinates at its corners
+        float ndc[2][2];
+        const float tangent[2] = { tanHalfX, tanHalfY };
+        for (int axis = 0; axis < 2; axis++)
+        {
+            float low = FLT_MAX, high = -FLT_MAX;
+            for (float side : {center[axis] - radius, center[axis] + radius})
+            {
+                for (float depth : {nearest, farthest})
+                {
+                    float value = side / (depth * tangent[axis]);
+                    low = std::min(low, value);
+                    high = std::max(high, value);
+                }
+            }
+            if (high < -1.0f || low > 1.0f)
+                return false;
+            ndc[axis][0] = low;
+            ndc[axis][1] = high;
+        }
+
+        int x0 = tileOf(ndc[0][0], GRID_X), x1 = tileOf(ndc[0][1], GRID_X);
+        int y0 = tileOf(ndc[1][0], GRID_Y), y1 = tileOf(ndc[1][1], GRID_Y);
+        int z0 = sliceOf(nearest), z1 = sliceOf(farthest);
+        float radius2 = radius * radius;
+        bool touched = false;
+        for (int z = z0; z <= z1; z++)
+        {
+            for (int y = y0; y <= y1; y++)
+            {
+                for (int x = x0; x <= x1; x++)
+                {
+                    int c = clusterIndex(x, y, z);
+                    glm::vec3 closest = glm::clamp(center, boundsMin[c], boundsMax[c]);
+                    glm::vec3 offset = closest - center;
+                    if (glm::dot(offset, offset) > radius2)
+                        continue;
+                    pairs.push_back({ (uint32_t)c, light });
+                    touched = true;
+                }
+            }
+        }
+        return touched;
+    }
+};
+
+// std140 mirror of the LightGrid block in clustered_lights.glsl
+struct LightGridData
+{
+    glm::vec4 ambient;
+    glm::ivec4 gridSize;        // tiles across, tiles up, slices, lights
+    glm::vec4 clusterScale;     // tiles per pixel across and up, slice scale and bias
+};
+
+// GPU side of LightClusters: the LightGrid uniform block at
+// LIGHT_GRID_BLOCK_BINDING and three buffer textures on the shared sampler
+// units. Everything stays bound from create() on, so upload() only
+// replaces buffer contents.
+class LightGridBuffer
+{
+public:
+    void create()
+    {
+        glGenBuffers(1, &uniformBuffer);
+        glState().bindBuffer(GL_UNIFORM_BUFFER, uniformBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(LightGridData), NULL, GL_DYNAMIC_DRAW);
+        glState().bindBufferBase(GL_UNIFORM_BUFFER, LIGHT_GRID_BLOCK_BINDING, uniformBuffer);
+
+        createTexture(lightData, LIGHT_DATA_UNIT, GL_RGBA32F);
+        createTexture(clusterRanges, CLUSTER_RANGES_UNIT, GL_RG32UI);
+        createTexture(lightIndices, LIGHT_INDICES_UNIT, GL_R16UI);
+    }
+
+    // Lights of `clusters` for a framebuffer of width x height pixels,
+    // on top of `ambient`
+    void upload(const LightClusters& clusters, const glm::vec3& ambient, int width, int height)
+    {
+        LightGridData data;
+        data.ambient = glm::vec4(ambient, 1.0f);
+        data.gridSize = glm::ivec4(LightClusters::GRID_X, LightClusters::GRID_Y, LightClusters::GRID_Z, (int)(clusters.lightTexels.size() / 2));
+        data.clusterScale = glm::vec4((float)LightClusters::GRID_X / std::max(width, 1), (float)LightClusters::GRID_Y / std::max(height, 1),
+            clusters.sliceScale, clusters.sliceBias);
+        glState().bindBuffer(GL_UNIFORM_BUFFER, uniformBuffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LightGridData), &data);
+
+        fillBuffer(lightData, clusters.lightTexels.data(), clusters.lightTexels.size() * sizeof(glm::vec4));
+        fillBuffer(clusterRanges, clusters.ranges.data(), clusters.ranges.size() * sizeof(uint32_t));
+        fillBuffer(lightIndices, clusters.indices.data(), clusters.indices.size() * sizeof(uint16_t));
+    }
+
+    void release()
+    {
+        for (TextureBuffer* texture : {&lightData, &clusterRanges, &lightIndices})
+        {
+            glDeleteTextures(1, &texture->texture);
+            glDeleteBuffers(1, &texture->buffer);
+        }
+        glDeleteBuffers(1, &uniformBuffer);
+        glState().invalidate();
+    }
+
+private:
+    struct TextureBuffer
+    {
+        unsigned int buffer = 0;
+        unsigned int texture = 0;
+    };
+
+    unsigned int uniformBuffer = 0;
+    TextureBuffer lightData, clusterRanges, lightIndices;
+
+    static void createTexture(TextureBuffer& target, GLint unit, GLenum format)
+    {
+        glGenBuffers(1, &target.buffer);
+        glGenTextures(1, &target.texture);
+        fillBuffer(target, nullptr, 0);
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_BUFFER, target.texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, target.buffer);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // Orphans the old storage so a frame still reading it is not waited on.
+    // A buffer texture may not be empty, hence the 16-byte floor.
+    static void fillBuffer(const TextureBuffer& target, const void* data, size_t bytes)
+    {
+        glState().bindBuffer(GL_TEXTURE_BUFFER, target.buffer);
+        glBufferData(GL_TEXTURE_BUFFER, std::max(bytes, (size_t)16), NULL, GL_STREAM_DRAW);
+        if (bytes > 0)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+    }
+};
+
+#endif
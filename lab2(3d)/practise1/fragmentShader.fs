@@ -5,5 +5,9 @@ out vec4 FragColor;
 
 void main()
 {
+#ifdef CONSTANT_COLOR
+    FragColor = vec4(1.0f, 0.2f, 0.3f, 1.0f);
+#else
     FragColor = color;
+#endif
 }
@@ -0,0 +1,108 @@
+//
+//  frame_pacer.h
+//  3D Object Drawing
+//
+
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <GLFW/glfw3.h>
+
+#include "async_logger.h"
+
+// Decides whether a loop iteration renders, and how the loop waits for the
+// next one. In continuous mode every iteration draws and events are polled.
+// In on-demand mode the loop only draws after requestRedraw() (input,
+// animation, a resize or an expose) and otherwise sleeps in
+// glfwWaitEventsTimeout, so an unchanged scene costs no CPU.
+class FramePacer
+{
+public:
+    struct Stats
+    {
+        unsigned int active = 0;     // iterations that rendered and presented
+        unsigned int idle = 0;       // iterations that found nothing to draw
+        double blockedSeconds = 0.0; // time spent asleep waiting for events
+    };
+
+    bool onDemand = false;
+    // upper bound on a single sleep, so reports and timers keep ticking
+    double idleTimeout = 0.5;
+    Stats stats;
+
+    // Redraws the window when the system asks for it (expose, resize).
+    void attach(GLFWwindow* window)
+    {
+        glfwSetWindowRefreshCallback(window, refreshCallback);
+        reportStart = glfwGetTime();
+    }
+
+    void requestRedraw()
+    {
+        redraw = true;
+    }
+
+    // True when this iteration has to render and present a frame.
+    bool beginFrame()
+    {
+        drew = !onDemand || redraw;
+        redraw = false;
+        if (drew) stats.active++; else stats.idle++;
+        return drew;
+    }
+
+    // Replaces glfwPollEvents() at the end of an iteration. Only sleeps after
+    // an iteration that had nothing to draw: a held key produces no events,
+    // so the loop has to look once more after every frame it renders.
+    // Returns the time spent asleep; callers leave it out of their frame
+    // delta so a key that wakes the loop does not apply the pause as movement.
+    double waitEvents()
+    {
+        if (!onDemand || redraw || drew)
+        {
+            glfwPollEvents();
+            return 0.0;
+        }
+        double start = glfwGetTime();
+        glfwWaitEventsTimeout(idleTimeout);
+        double blocked = glfwGetTime() - start;
+        stats.blockedSeconds += blocked;
+        return blocked;
+    }
+
+    // Prints the active/idle split every `interval` seconds in on-demand mode.
+    void report(double interval = 5.0)
+    {
+        double now = glfwGetTime();
+        double elapsed = now - reportStart;
+        if (!onDemand || elapsed < interval)
+            return;
+
+        unsigned int total = stats.active + stats.idle;
+        logger().log("On-demand: %u frames drawn, %u idle wakeups (%.1f%% idle), asleep %.1f%% of the last %.1f s",
+            stats.active, stats.idle, total ? 100.0 * stats.idle / total : 0.0,
+            100.0 * stats.blockedSeconds / elapsed, elapsed);
+        stats = Stats();
+        reportStart = now;
+    }
+
+private:
+    bool redraw = true;
+    bool drew = true;
+    double reportStart = 0.0;
+
+    static void refreshCallback(GLFWwindow*);
+};
+
+inline FramePacer& framePacer()
+{
+    static FramePacer pacer;
+    return pacer;
+}
+
+inline void FramePacer::refreshCallback(GLFWwindow*)
+{
+    framePacer().requestRedraw();
+}
+
+#endif
@@ -0,0 +1,258 @@
+//
+//  geometry_pool.h
+//  3D Object Drawing
+//
+
+#ifndef GEOMETRY_POOL_H
+#define GEOMETRY_POOL_H
+
+#include <glad/glad.h>
+
+#include "gl_state.h"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+
+// First-fit allocator over [0, capacity). Free blocks are kept sorted by
+// offset and merged with their neighbours when a range is returned.
+class FreeListAllocator
+{
+public:
+    void reset(size_t capacity)
+    {
+        blocks.clear();
+        blocks.push_back({ 0, capacity });
+    }
+
+    bool allocate(size_t size, size_t alignment, size_t& offset)
+    {
+        for (size_t i = 0; i < blocks.size(); i++)
+        {
+            Block& block = blocks[i];
+            size_t aligned = (block.offset + alignment - 1) / alignment * alignment;
+            size_t padding = aligned - block.offset;
+            if (block.size < size + padding)
+                continue;
+
+            offset = aligned;
+            size_t tail = block.size - size - padding;
+            if (padding > 0)
+            {
+                // keep the alignment gap as its own free block
+                block.size = padding;
+                if (tail > 0)
+                    blocks.insert(blocks.begin() + i + 1, { aligned + size, tail });
+            }
+            else if (tail > 0)
+            {
+                block.offset = aligned + size;
+                block.size = tail;
+            }
+            else
+            {
+                blocks.erase(blocks.begin() + i);
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void release(size_t offset, size_t size)
+    {
+        size_t i = 0;
+        while (i < blocks.size() && blocks[i].offset < offset)
+            i++;
+        blocks.insert(blocks.begin() + i, { offset, size });
+
+        if (i + 1 < blocks.size() && blocks[i].offset + blocks[i].size == blocks[i + 1].offset)
+        {
+            blocks[i].size += blocks[i + 1].size;
+            blocks.erase(blocks.begin() + i + 1);
+        }
+        if (i > 0 && blocks[i - 1].offset + blocks[i - 1].size == blocks[i].offset)
+        {
+            blocks[i - 1].size += blocks[i].size;
+            blocks.erase(blocks.begin() + i);
+        }
+    }
+
+private:
+    struct Block
+    {
+        size_t offset;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+};
+
+// A mesh living inside a GeometryPool. Indices are relative to baseVertex,
+// and firstIndex counts elements of indexType from the start of the pool's
+// index buffer.
+struct Mesh
+{
+    GLint baseVertex = 0;
+    GLuint firstIndex = 0;
+    GLsizei count = 0;
+    GLenum indexType = GL_UNSIGNED_SHORT;
+    GLuint vertexCount = 0;
+
+    size_t indexByteOffset() const
+    {
+        return firstIndex * (indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t));
+    }
+};
+
+// One vertex buffer and one index buffer shared by every mesh of a vertex
+// format, behind a single VAO. Meshes are sub-allocated from free lists and
+// drawn with glDrawElementsBaseVertex, so switching meshes never rebinds
+// anything. Indices are stored as uint16 whenever the mesh has at most 65536
+// vertices, which thanks to baseVertex is nearly always.
+class GeometryPool
+{
+public:
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+
+    // Leaves the VAO and VBO bound so the caller can describe the vertex
+    // attributes with glVertexAttribPointer right away.
+    void create(size_t vertexStride, size_t maxVertices, size_t maxIndexBytes)
+    {
+        stride = vertexStride;
+        vertices.reset(maxVertices);
+        indexBytes.reset(maxIndexBytes);
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        glState().bindVertexArray(VAO);
+        glState().bindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, maxVertices * stride, NULL, GL_STATIC_DRAW);
+        glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, maxIndexBytes, NULL, GL_STATIC_DRAW);
+    }
+
+    // create() with buffer images that are uploaded as they are, e.g. from
+    // a mapped scene file; the whole of both images counts as in use and
+    // describing the meshes inside them is up to the caller.
+    void createFilled(size_t vertexStride, const void* vertexData, size_t vertexCount, const void* indexData, size_t indexByteCount)
+    {
+        create(vertexStride, vertexCount, indexByteCount);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, vertexCount * stride, vertexData);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indexByteCount, indexData);
+        size_t offset;
+        vertices.allocate(vertexCount, 1, offset);
+        indexBytes.allocate(indexByteCount, 1, offset);
+    }
+
+    Mesh add(const void* vertexData, size_t vertexCount, const unsigned int* indices, size_t indexCount)
+    {
+        Mesh mesh;
+        bool shortIndices = vertexCount <= 65536;
+        size_t indexSize = shortIndices ? sizeof(uint16_t) : sizeof(uint32_t);
+
+        size_t vertexOffset = 0, indexOffset = 0;
+        if (!vertices.allocate(vertexCount, 1, vertexOffset))
+        {
+            std::cout << "ERROR::GEOMETRY_POOL::OUT_OF_VERTEX_SPACE (" << vertexCount << " vertices)" << std::endl;
+            return mesh;
+        }
+        if (!indexBytes.allocate(indexCount * indexSize, sizeof(uint32_t), indexOffset))
+        {
+            vertices.release(vertexOffset, vertexCount);
+            std::cout << "ERROR::GEOMETRY_POOL::OUT_OF_INDEX_SPACE (" << indexCount << " indices)" << std::endl;
+            return mesh;
+        }
+
+        mesh.baseVertex = (GLint)vertexOffset;
+        mesh.vertexCount = (GLuint)vertexCount;
+        mesh.indexType = shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        mesh.firstIndex = (GLuint)(indexOffset / indexSize);
+        mesh.count = (GLsizei)indexCount;
+
+        // the element array binding belongs to the VAO
+        glState().bindVertexArray(VAO);
+        glState().bindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, vertexOffset * stride, vertexCount * stride, vertexData);
+        if (shortIndices)
+        {
+            std::vector<uint16_t> narrow(indices, indices + indexCount);
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indexOffset, indexCount * indexSize, narrow.data());
+        }
+        else
+        {
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indexOffset, indexCount * indexSize, indices);
+        }
+        return mesh;
+    }
+
+    void remove(const Mesh& mesh)
+    {
+        size_t indexSize = mesh.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+        vertices.release(mesh.baseVertex, mesh.vertexCount);
+        indexBytes.release(mesh.indexByteOffset(), mesh.count * indexSize);
+    }
+
+    void bind() const
+    {
+        glState().bindVertexArray(VAO);
+    }
+
+    void draw(const Mesh& mesh) const
+    {
+        bind();
+        glDrawElementsBaseVertex(GL_TRIANGLES, mesh.count, mesh.indexType, (void*)mesh.indexByteOffset(), mesh.baseVertex);
+    }
+
+    void drawInstanced(const Mesh& mesh, GLsizei instances) const
+    {
+        bind();
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, mesh.count, mesh.indexType, (void*)mesh.indexByteOffset(), instances, mesh.baseVertex);
+    }
+
+    // Draws a list of meshes with one glMultiDrawElementsBaseVertex per run
+    // of equal index type, which for small meshes means one call.
+    void drawMany(const Mesh* const* meshes, size_t meshCount) const
+    {
+        bind();
+        size_t first = 0;
+        while (first < meshCount)
+        {
+            GLenum indexType = meshes[first]->indexType;
+            counts.clear();
+            offsets.clear();
+            baseVertices.clear();
+            size_t i = first;
+            for (; i < meshCount && meshes[i]->indexType == indexType; i++)
+            {
+                counts.push_back(meshes[i]->count);
+                offsets.push_back((const void*)meshes[i]->indexByteOffset());
+                baseVertices.push_back(meshes[i]->baseVertex);
+            }
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), indexType, offsets.data(), (GLsizei)counts.size(), baseVertices.data());
+            first = i;
+        }
+    }
+
+    void release()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        glState().invalidate();
+    }
+
+private:
+    size_t stride = 0;
+    FreeListAllocator vertices;    // in vertices
+    FreeListAllocator indexBytes;  // in bytes, so uint16 and uint32 meshes can share the buffer
+
+    // scratch for drawMany()
+    mutable std::vector<GLsizei> counts;
+    mutable std::vector<const void*> offsets;
+    mutable std::vector<GLint> baseVertices;
+};
+
+#endif
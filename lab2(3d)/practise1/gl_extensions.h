@@ -0,0 +1,118 @@
+//
+//  gl_extensions.h
+//  3D Object Drawing
+//
+
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <cstring>
+
+// The glad loader in these projects is generated for a 3.3 core context, so
+// anything newer is looked up by hand once the context exists.
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+
+struct GLExtensions
+{
+    int version = 0;                     // major * 10 + minor
+    std::vector<std::string> names;
+
+    bool parallelShaderCompile = false;  // KHR/ARB_parallel_shader_compile
+    bool programBinary = false;          // GL 4.1 or ARB_get_program_binary, with a format to use
+    bool multiDrawIndirect = false;      // GL 4.3 (indirect multi-draw and storage buffers)
+    bool shaderDrawParameters = false;   // GL 4.6 or ARB_shader_draw_parameters (gl_DrawID)
+
+    void (APIENTRY* getProgramBinary)(GLuint, GLsizei, GLsizei*, GLenum*, void*) = nullptr;
+    void (APIENTRY* programBinaryLoad)(GLuint, GLenum, const void*, GLsizei) = nullptr;
+    void (APIENTRY* programParameteri)(GLuint, GLenum, GLint) = nullptr;
+    void (APIENTRY* maxShaderCompilerThreads)(GLuint) = nullptr;
+    void (APIENTRY* multiDrawElementsIndirect)(GLenum, GLenum, const void*, GLsizei, GLsizei) = nullptr;
+
+    bool has(const char* name) const
+    {
+        for (const std::string& n : names)
+        {
+            if (n == name)
+                return true;
+        }
+        return false;
+    }
+};
+
+inline GLExtensions& glExt()
+{
+    static GLExtensions ext;
+    return ext;
+}
+
+// Call right after gladLoadGLLoader, with the same loader.
+inline void loadGLExtensions(GLADloadproc load)
+{
+    GLExtensions& ext = glExt();
+
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    ext.version = major * 10 + minor;
+
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    ext.names.clear();
+    for (GLint i = 0; i < count; i++)
+        ext.names.push_back((const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i));
+
+    if (ext.version >= 41 || ext.has("GL_ARB_get_program_binary"))
+    {
+        ext.getProgramBinary = (void (APIENTRY*)(GLuint, GLsizei, GLsizei*, GLenum*, void*))load("glGetProgramBinary");
+        ext.programBinaryLoad = (void (APIENTRY*)(GLuint, GLenum, const void*, GLsizei))load("glProgramBinary");
+        ext.programParameteri = (void (APIENTRY*)(GLuint, GLenum, GLint))load("glProgramParameteri");
+
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        ext.programBinary = formats > 0 && ext.getProgramBinary && ext.programBinaryLoad && ext.programParameteri;
+    }
+
+    if (ext.version >= 43)
+    {
+        ext.multiDrawElementsIndirect = (void (APIENTRY*)(GLenum, GLenum, const void*, GLsizei, GLsizei))load("glMultiDrawElementsIndirect");
+        ext.multiDrawIndirect = ext.multiDrawElementsIndirect != nullptr;
+    }
+    ext.shaderDrawParameters = ext.version >= 46 || ext.has("GL_ARB_shader_draw_parameters");
+
+    if (ext.has("GL_KHR_parallel_shader_compile"))
+        ext.maxShaderCompilerThreads = (void (APIENTRY*)(GLuint))load("glMaxShaderCompilerThreadsKHR");
+    else if (ext.has("GL_ARB_parallel_shader_compile"))
+        ext.maxShaderCompilerThreads = (void (APIENTRY*)(GLuint))load("glMaxShaderCompilerThreadsARB");
+    if (ext.maxShaderCompilerThreads)
+    {
+        // let the driver pick the number of compiler threads
+        ext.maxShaderCompilerThreads(0xFFFFFFFFu);
+        ext.parallelShaderCompile = true;
+    }
+}
+
+#endif
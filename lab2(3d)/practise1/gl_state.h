@@ -0,0 +1,183 @@
+//
+//  gl_state.h
+//  3D Object Drawing
+//
+
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+// Shadows the pieces of GL state the render loop keeps touching (program,
+// VAO, buffer bindings, depth and blend) and drops calls that would not
+// change anything. Everything starts out "unknown" so the first call of
+// each kind always reaches the driver.
+class GLStateCache
+{
+public:
+    struct Counters
+    {
+        unsigned int issued = 0;
+        unsigned int elided = 0;
+    };
+
+    // running totals for the frame being recorded, and the last finished one
+    Counters frame;
+    Counters lastFrame;
+
+    GLStateCache()
+    {
+        invalidate();
+    }
+
+    void useProgram(GLuint program)
+    {
+        if (program == currentProgram) { frame.elided++; return; }
+        glUseProgram(program);
+        currentProgram = program;
+        frame.issued++;
+    }
+
+    void bindVertexArray(GLuint vao)
+    {
+        if (vao == currentVAO) { frame.elided++; return; }
+        glBindVertexArray(vao);
+        currentVAO = vao;
+        // the element array binding is part of the VAO
+        setSlot(GL_ELEMENT_ARRAY_BUFFER, UNKNOWN);
+        frame.issued++;
+    }
+
+    void bindBuffer(GLenum target, GLuint buffer)
+    {
+        Slot* slot = findSlot(target);
+        if (slot && slot->buffer == buffer) { frame.elided++; return; }
+        glBindBuffer(target, buffer);
+        if (slot) slot->buffer = buffer;
+        frame.issued++;
+    }
+
+    // indexed binding points are not shadowed, but the call also changes the
+    // generic binding of the target
+    void bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+    {
+        glBindBufferBase(target, index, buffer);
+        setSlot(target, buffer);
+        frame.issued++;
+    }
+
+    void setDepthTest(bool enabled)
+    {
+        setCapability(GL_DEPTH_TEST, enabled, depthTest);
+    }
+
+    void setBlend(bool enabled)
+    {
+        setCapability(GL_BLEND, enabled, blend);
+    }
+
+    void setDepthFunc(GLenum func)
+    {
+        if (func == depthFunc) { frame.elided++; return; }
+        glDepthFunc(func);
+        depthFunc = func;
+        frame.issued++;
+    }
+
+    void setDepthMask(bool write)
+    {
+        int value = write ? 1 : 0;
+        if (value == depthMask) { frame.elided++; return; }
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+        depthMask = value;
+        frame.issued++;
+    }
+
+    void setBlendFunc(GLenum src, GLenum dst)
+    {
+        if (src == blendSrc && dst == blendDst) { frame.elided++; return; }
+        glBlendFunc(src, dst);
+        blendSrc = src;
+        blendDst = dst;
+        frame.issued++;
+    }
+
+    // call after code that bypasses the cache (or deletes bound objects)
+    void invalidate()
+    {
+        currentProgram = UNKNOWN;
+        currentVAO = UNKNOWN;
+        for (Slot& slot : slots)
+            slot.buffer = UNKNOWN;
+        depthTest = -1;
+        blend = -1;
+        depthMask = -1;
+        depthFunc = UNKNOWN;
+        blendSrc = UNKNOWN;
+        blendDst = UNKNOWN;
+    }
+
+    void endFrame()
+    {
+        lastFrame = frame;
+        frame = Counters();
+    }
+
+private:
+    static const GLuint UNKNOWN = 0xFFFFFFFFu;
+
+    struct Slot
+    {
+        GLenum target;
+        GLuint buffer;
+    };
+
+    Slot slots[4] = {
+        { GL_ARRAY_BUFFER, UNKNOWN },
+        { GL_ELEMENT_ARRAY_BUFFER, UNKNOWN },
+        { GL_UNIFORM_BUFFER, UNKNOWN },
+        { GL_TEXTURE_BUFFER, UNKNOWN },
+    };
+
+    GLuint currentProgram;
+    GLuint currentVAO;
+    int depthTest;
+    int blend;
+    int depthMask;
+    GLenum depthFunc;
+    GLenum blendSrc;
+    GLenum blendDst;
+
+    Slot* findSlot(GLenum target)
+    {
+        for (Slot& slot : slots)
+        {
+            if (slot.target == target)
+                return &slot;
+        }
+        return nullptr;
+    }
+
+    void setSlot(GLenum target, GLuint buffer)
+    {
+        if (Slot* slot = findSlot(target))
+            slot->buffer = buffer;
+    }
+
+    void setCapability(GLenum cap, bool enabled, int& shadow)
+    {
+        int value = enabled ? 1 : 0;
+        if (value == shadow) { frame.elided++; return; }
+        if (enabled) glEnable(cap); else glDisable(cap);
+        shadow = value;
+        frame.issued++;
+    }
+};
+
+inline GLStateCache& glState()
+{
+    static GLStateCache state;
+    return state;
+}
+
+#endif
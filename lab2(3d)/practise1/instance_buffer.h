@@ -0,0 +1,116 @@
+//
+//  instance_buffer.h
+//  3D Object Drawing
+//
+
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+
+#include <cstddef>
+
+// Per-instance data for shaders that take a colour along with the matrix.
+// Lit shaders also read the normal matrix, which stays zero until
+// withNormalMatrix() fills it in; its columns are padded to vec4 so the
+// record keeps the std430 layout of a GLSL mat3.
+struct ColoredInstance
+{
+    glm::mat4 model;
+    glm::vec4 color;
+    glm::vec4 normalMatrix[3] = {};
+};
+
+// The instance with the inverse transpose of its model matrix, which keeps
+// normals perpendicular under uneven scale
+inline ColoredInstance withNormalMatrix(ColoredInstance instance)
+{
+    glm::mat3 normal = glm::transpose(glm::inverse(glm::mat3(instance.model)));
+    for (int column = 0; column < 3; column++)
+        instance.normalMatrix[column] = glm::vec4(normal[column], 0.0f);
+    return instance;
+}
+
+// Streams per-instance model matrices for glDraw*Instanced. The matrix is
+// fed to four consecutive vec4 attributes (INSTANCE_MODEL_LOCATION .. +3)
+// with a divisor of 1, matching "in mat4 aModel" in the INSTANCED shaders.
+// A buffer attached with attachColored() carries ColoredInstance records
+// instead and also feeds INSTANCE_COLOR_LOCATION and the three vec3
+// columns of "in mat3 aNormalMatrix" from INSTANCE_NORMAL_LOCATION.
+class InstanceBuffer
+{
+public:
+    static const GLuint INSTANCE_MODEL_LOCATION = 2;
+    static const GLuint INSTANCE_COLOR_LOCATION = 6;
+    static const GLuint INSTANCE_NORMAL_LOCATION = 8;
+
+    unsigned int ID = 0;
+
+    // Points the instance attributes of a VAO at this buffer. A VAO remembers
+    // the buffer per attribute, so this is done once for every VAO drawn with it.
+    void attach(unsigned int VAO)
+    {
+        attachModel(VAO, sizeof(glm::mat4));
+    }
+
+    void attachColored(unsigned int VAO)
+    {
+        attachModel(VAO, sizeof(ColoredInstance));
+        glVertexAttribPointer(INSTANCE_COLOR_LOCATION, 4, GL_FLOAT, GL_FALSE, sizeof(ColoredInstance), (void*)offsetof(ColoredInstance, color));
+        glEnableVertexAttribArray(INSTANCE_COLOR_LOCATION);
+        glVertexAttribDivisor(INSTANCE_COLOR_LOCATION, 1);
+        for (GLuint column = 0; column < 3; column++)
+        {
+            GLuint location = INSTANCE_NORMAL_LOCATION + column;
+            size_t offset = offsetof(ColoredInstance, normalMatrix) + column * sizeof(glm::vec4);
+            glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(ColoredInstance), (void*)offset);
+            glEnableVertexAttribArray(location);
+            glVertexAttribDivisor(location, 1);
+        }
+    }
+
+    void upload(const glm::mat4* models, size_t count)
+    {
+        uploadBytes(models, count * sizeof(glm::mat4));
+    }
+
+    void upload(const ColoredInstance* instances, size_t count)
+    {
+        uploadBytes(instances, count * sizeof(ColoredInstance));
+    }
+
+private:
+    size_t capacity = 0;
+
+    void attachModel(unsigned int VAO, GLsizei stride)
+    {
+        if (ID == 0)
+            glGenBuffers(1, &ID);
+
+        glState().bindVertexArray(VAO);
+        glState().bindBuffer(GL_ARRAY_BUFFER, ID);
+        for (GLuint column = 0; column < 4; column++)
+        {
+            GLuint location = INSTANCE_MODEL_LOCATION + column;
+            glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride, (void*)(column * sizeof(glm::vec4)));
+            glEnableVertexAttribArray(location);
+            glVertexAttribDivisor(location, 1);
+        }
+    }
+
+    // Orphans the storage before writing, so the driver never waits on a
+    // draw that is still reading the previous instances.
+    void uploadBytes(const void* data, size_t bytes)
+    {
+        if (bytes > capacity)
+            capacity = bytes;
+        glState().bindBuffer(GL_ARRAY_BUFFER, ID);
+        glBufferData(GL_ARRAY_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, data);
+    }
+};
+
+#endif
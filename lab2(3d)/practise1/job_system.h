@@ -0,0 +1,220 @@
+//
+//  job_system.h
+//  3D Object Drawing
+//
+
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+// Work-stealing thread pool for data-parallel loops. parallelFor() deals
+// the indices of a loop round-robin onto one deque per thread; each thread
+// takes from the back of its own deque and, once that is empty, steals from
+// the front of the others, so a thread that drew the cheap jobs helps with
+// the expensive ones. The calling thread works as thread 0 and returns when
+// every index has run. One loop runs at a time, and the body must not call
+// parallelFor() itself.
+class JobSystem
+{
+public:
+    struct Stats
+    {
+        size_t jobs = 0;
+        size_t stolen = 0;      // jobs run by a thread other than the one dealt
+    };
+
+    JobSystem()
+    {
+        start(1);
+    }
+
+    ~JobSystem()
+    {
+        stop();
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // Threads including the caller; 1 runs every loop inline
+    void setThreadCount(unsigned int threads)
+    {
+        if (threads < 1)
+            threads = 1;
+        if (threads == queues.size())
+            return;
+        stop();
+        start(threads);
+    }
+
+    unsigned int threadCount() const
+    {
+        return (unsigned int)queues.size();
+    }
+
+    Stats stats() const
+    {
+        Stats result;
+        result.jobs = jobsRun.load(std::memory_order_relaxed);
+        result.stolen = jobsStolen.load(std::memory_order_relaxed);
+        return result;
+    }
+
+    void resetStats()
+    {
+        jobsRun.store(0, std::memory_order_relaxed);
+        jobsStolen.store(0, std::memory_order_relaxed);
+    }
+
+    void parallelFor(size_t count, const std::function<void(size_t)>& job)
+    {
+        if (count == 0)
+            return;
+        if (workers.empty())
+        {
+            for (size_t i = 0; i < count; i++)
+                job(i);
+            jobsRun.fetch_add(count, std::memory_order_relaxed);
+            return;
+        }
+
+        body = &job;
+        remaining.store(count, std::memory_order_release);
+        for (size_t i = 0; i < count; i++)
+        {
+            Queue& queue = *queues[i % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(i);
+        }
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            generation++;
+        }
+        wake.notify_all();
+
+        work(0);
+        body = nullptr;
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<size_t> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;     // [0] belongs to the caller
+    std::vector<std::thread> workers;
+    const std::function<void(size_t)>* body = nullptr;
+    std::atomic<size_t> remaining{0};
+    std::atomic<size_t> jobsRun{0};
+    std::atomic<size_t> jobsStolen{0};
+
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    uint64_t generation = 0;
+    bool quitting = false;
+
+    void start(unsigned int threads)
+    {
+        quitting = false;
+        for (unsigned int i = 0; i < threads; i++)
+            queues.emplace_back(new Queue());
+        for (unsigned int i = 1; i < threads; i++)
+            workers.emplace_back(&JobSystem::workerMain, this, (size_t)i);
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            quitting = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+        workers.clear();
+        queues.clear();
+    }
+
+    void workerMain(size_t self)
+    {
+        uint64_t seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                wake.wait(lock, [&] { return quitting || generation != seen; });
+                if (quitting)
+                    return;
+                seen = generation;
+            }
+            work(self);
+        }
+    }
+
+    // Runs jobs until the loop is finished; the last few may still be
+    // running on other threads, which is waited out by yielding
+    void work(size_t self)
+    {
+        while (remaining.load(std::memory_order_acquire) > 0)
+        {
+            size_t index;
+            bool stolen = false;
+            if (!popOwn(self, index) && !(stolen = steal(self, index)))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            (*body)(index);
+            jobsRun.fetch_add(1, std::memory_order_relaxed);
+            if (stolen)
+                jobsStolen.fetch_add(1, std::memory_order_relaxed);
+            remaining.fetch_sub(1, std::memory_order_acq_rel);
+        }
+    }
+
+    bool popOwn(size_t self, size_t& index)
+    {
+        Queue& queue = *queues[self];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.jobs.empty())
+            return false;
+        index = queue.jobs.back();
+        queue.jobs.pop_back();
+        return true;
+    }
+
+    bool steal(size_t self, size_t& index)
+    {
+        for (size_t offset = 1; offset < queues.size(); offset++)
+        {
+            Queue& queue = *queues[(self + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.jobs.empty())
+                continue;
+            index = queue.jobs.front();
+            queue.jobs.pop_front();
+            return true;
+        }
+        return false;
+    }
+};
+
+// The process-wide pool, sized with setThreadCount()
+inline JobSystem& jobSystem()
+{
+    static JobSystem system;
+    return system;
+}
+
+#endif
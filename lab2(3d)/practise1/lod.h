@@ -0,0 +1,88 @@
+//
+//  lod.h
+//  3D Object Drawing
+//
+
+#ifndef LOD_H
+#define LOD_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cmath>
+
+// Radius in pixels of a circle of `radius` world units around `center` once
+// projected. Uses the distance along the view axis, which is what the
+// perspective divide scales by; a circle the camera is inside of (or that
+// is behind it) counts as filling the viewport.
+inline float projectedRadius(const glm::vec3& center, float radius, const glm::mat4& view, const glm::mat4& proj, float viewportHeight)
+{
+    float depth = -(view * glm::vec4(center, 1.0f)).z;
+    if (depth <= radius)
+        return viewportHeight;
+    return radius * proj[1][1] * 0.5f * viewportHeight / depth;
+}
+
+// Screen radius above which a ring of `segments` straight edges is off the
+// true circle by more than `errorPixels` (the sagitta r * (1 - cos(pi / n))).
+inline float lodSwitchRadius(int segments, float errorPixels)
+{
+    return errorPixels / (1.0f - std::cos(3.14159265359f / segments));
+}
+
+// Picks a detail level per draw from its screen radius. Level i + 1 is
+// taken once the radius grows past thresholds[i], but only given back once
+// the radius drops below thresholds[i] * (1 - hysteresis), so a draw
+// sitting on a boundary does not flip every frame.
+//
+// The selector keeps the current level of every draw slot. Draws with a
+// stable identity pass their own slot below the count reserved in
+// beginFrame(); the others get slots in call order after it, so they have
+// to be issued in the same order each frame for the state to follow the
+// right object. A changed order only costs one frame without hysteresis.
+class LodSelector
+{
+public:
+    float hysteresis = 0.2f;
+
+    // `count` thresholds in increasing order, for count + 1 levels
+    void setThresholds(const float* pixels, int count)
+    {
+        thresholds.assign(pixels, pixels + count);
+        levels.clear();
+    }
+
+    int levelCount() const
+    {
+        return (int)thresholds.size() + 1;
+    }
+
+    void beginFrame(size_t reservedSlots = 0)
+    {
+        next = reservedSlots;
+    }
+
+    int select(float screenRadius)
+    {
+        return select(next++, screenRadius);
+    }
+
+    int select(size_t slot, float screenRadius)
+    {
+        if (slot >= levels.size())
+            levels.resize(slot + 1, 0);
+        int& level = levels[slot];
+        while (level < (int)thresholds.size() && screenRadius > thresholds[level])
+            level++;
+        while (level > 0 && screenRadius < thresholds[level - 1] * (1.0f - hysteresis))
+            level--;
+        return level;
+    }
+
+private:
+    std::vector<float> thresholds;
+    std::vector<int> levels;
+    size_t next = 0;
+};
+
+#endif
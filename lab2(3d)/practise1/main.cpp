@@ -16,8 +16,22 @@
 
 #include "shader.h"
 #include "basic_camera.h"
+#include "gl_state.h"
+#include "camera_buffer.h"
+#include "gl_extensions.h"
+#include "program_cache.h"
+#include "instance_buffer.h"
+#include "geometry_pool.h"
+#include "scene_graph.h"
+#include "frame_pacer.h"
+#include "async_logger.h"
 
 #include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
 
 using namespace std;
 
@@ -27,9 +41,25 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void printMatrix4(glm::mat4 matrix, string name);
 void processInput(GLFWwindow* window);
 
+void benchmarkUniformSetters(const Shader& shaderProgram, int iterations);
+void runCubeStress(GLFWwindow* window, const Shader& perDrawShader, const Shader& instancedShader, const Mesh& mesh, CameraBuffer& cameraBuffer, int count);
+
 // draw object functions
-void drawAxes(Shader shaderProgram, unsigned int VAO, glm::mat4 parentTrans);
-void drawCube(Shader shaderProgram, unsigned int VAO, glm::mat4 parentTrans, float posX = 0.0, float posY = 0.0, float posz = 0.0, float rotX = 0.0, float rotY = 0.0, float rotZ = 0.0, float scX = 1.0, float scY = 1.0, float scZ = 1.0);
+void drawCube(const Shader& shaderProgram, const Mesh& mesh, const glm::mat4& model);
+void drawCubesInstanced(const Shader& shaderProgram, const Mesh& mesh, const glm::mat4* models, size_t count);
+glm::mat4 cubeModel(const glm::mat4& parentTrans, float posX, float posY, float posZ, float rotX, float rotY, float rotZ, float scX, float scY, float scZ);
+
+// every mesh of the position + colour vertex format, behind a single VAO
+GeometryPool geometry;
+
+// per-instance model matrices for drawCubesInstanced, attached to the pool VAO
+InstanceBuffer cubeInstances;
+
+// transform hierarchy of everything drawn in the render loop
+SceneGraph scene;
+
+// uniform handles, resolved against each program when it links
+const Uniform<glm::mat4> uModel("model");
 
 // settings
 const unsigned int SCR_WIDTH = 800;
@@ -76,8 +106,22 @@ BasicCamera basic_camera(eyeX, eyeY, eyeZ, lookAtX, lookAtY, lookAtZ, V);
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
-int main()
+int main(int argc, char** argv)
 {
+    auto startupBegin = chrono::steady_clock::now();
+
+    bool benchUniforms = false;
+    int stressCubes = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--bench-uniforms") == 0)
+            benchUniforms = true;
+        else if (strcmp(argv[i], "--stress") == 0)
+            stressCubes = (i + 1 < argc) ? atoi(argv[++i]) : 100000;
+        else if (strcmp(argv[i], "--on-demand") == 0)
+            framePacer().onDemand = true;
+    }
+
     // glfw: initialize and configure
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -99,6 +143,7 @@ int main()
     glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    framePacer().attach(window);
 
     // glad: load all OpenGL function pointers
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
@@ -106,13 +151,28 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    loadGLExtensions((GLADloadproc)glfwGetProcAddress);
 
     // configure global opengl state
-    glEnable(GL_DEPTH_TEST);
+    glState().setDepthTest(true);
 
-    // build and compile our shader program
-    Shader ourShader("vertexShader.vs", "fragmentShader.fs");
-    Shader constantShader("vertexShader.vs", "fragmentShaderV2.fs");
+    // build and compile our shader program; cached binaries load immediately,
+    // anything else compiles in the background while the loop keeps running
+    ProgramCache programs;
+    Shader& ourShader = programs.request("vertexShader.vs", "fragmentShader.fs");
+    Shader& ourInstancedShader = programs.request("vertexShader.vs", "fragmentShader.fs", SHADER_INSTANCED);
+    Shader& constantInstancedShader = programs.request("vertexShader.vs", "fragmentShader.fs", SHADER_CONSTANT_COLOR | SHADER_INSTANCED);
+
+    // projection and view for every program, bound once at CAMERA_BLOCK_BINDING
+    CameraBuffer cameraBuffer;
+
+    if (benchUniforms)
+    {
+        programs.finishAll();
+        benchmarkUniformSetters(ourShader, 200000);
+        glfwTerminate();
+        return 0;
+    }
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
     float cube_vertices[] = {
@@ -196,48 +256,54 @@ int main()
        4, 0, 1
    };
 
-    unsigned int VBO, VAO, EBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-
-    glBindVertexArray(VAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cube_indices), cube_indices, GL_STATIC_DRAW);
+    // room for far more than the two cubes; the pool is shared by every mesh
+    geometry.create(6 * sizeof(float), 65536, 256 * 1024);
 
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)12);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(1);
 
+    Mesh cube = geometry.add(cube_vertices, 24, cube_indices, 36);
+    Mesh cube2 = geometry.add(cube_vertices2, 8, cube_indices2, 36);
 
-    unsigned int VBO2, VAO2, EBO2;
-    glGenVertexArrays(1, &VAO2);
-    glGenBuffers(1, &VBO2);
-    glGenBuffers(1, &EBO2);
+    cubeInstances.attach(geometry.VAO);
 
-    glBindVertexArray(VAO2);
+    glState().bindVertexArray(0);
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO2);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices2), cube_vertices2, GL_STATIC_DRAW);
+    if (stressCubes > 0)
+    {
+        programs.finishAll();
+        runCubeStress(window, ourShader, ourInstancedShader, cube, cameraBuffer, stressCubes);
+        glfwTerminate();
+        return 0;
+    }
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO2);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cube_indices2), cube_indices2, GL_STATIC_DRAW);
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
 
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+    // The cubes hang off a node carrying the shared IJKL translation; each
+    // keeps its own offset, rotation and scale and is centred on its pivot.
+    Transform cubeLocal;
+    cubeLocal.origin = glm::vec3(-0.25f);
+    int modelNode = scene.addNode(SceneGraph::NO_PARENT);
+    int cube1Node = scene.addNode(modelNode, cubeLocal);
+    int cube2Node = scene.addNode(modelNode, cubeLocal);
 
-    glBindVertexArray(0);
+    // the two axes are added back to back so they upload as one range
+    Transform axisLocal = cubeLocal;
+    axisLocal.scale = glm::vec3(100.0f, 0.1f, 0.1f);
+    int axesNode = scene.addNode(SceneGraph::NO_PARENT, axisLocal);
+    axisLocal.scale = glm::vec3(0.1f, 100.0f, 0.1f);
+    scene.addNode(SceneGraph::NO_PARENT, axisLocal);
 
+    // per-frame GL call statistics, reported once a second
+    float statsTimer = 0.0f;
+    int sceneUpdated = 0;
 
+    // what the last presented frame was drawn with, for on-demand mode
+    glm::mat4 shownProjection(0.0f), shownView(0.0f);
+    bool firstFrameDrawn = false;
 
     // render loop
     while (!glfwWindowShouldClose(window))
@@ -248,43 +314,87 @@ int main()
 
         processInput(window);
 
-        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-
+        // keep presenting (and handling input) while programs compile
+        if (programs.poll() > 0)
+        {
+            glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glfwSwapBuffers(window);
+            framePacer().requestRedraw();
+            lastFrame += (float)framePacer().waitEvents();
+            continue;
+        }
 
         glm::mat4 projection = glm::perspective(glm::radians(basic_camera.Zoom), 
             (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
         
         
         
-        ourShader.use();
-        ourShader.setMat4("projection", projection);
-        constantShader.use();
-        constantShader.setMat4("projection", projection);
-
         glm::mat4 view = basic_camera.createViewMatrix();
-        ourShader.use();
-        ourShader.setMat4("view", view);
-
         printMatrix4(view, "View");
-        constantShader.use();
-        constantShader.setMat4("view", view);
 
-        glm::mat4 identityMatrix = glm::mat4(1.0f);
-        drawCube(ourShader, VAO, identityMatrix, translate_X+cube1_X, translate_Y,
-            translate_Z, rotateAngle_X, rotateAngle_Y, rotateAngle_Z, scale_X, scale_Y, scale_Z);
-        drawCube(ourShader, VAO2, identityMatrix, translate_X+cube2_X, translate_Y, translate_Z, rotateAngle_X, rotateAngle_Y, rotateAngle_Z, scale_X, scale_Y, scale_Z);
+        // only nodes whose inputs changed (and their children) are recomputed
+        glm::vec3 rotation(rotateAngle_X, rotateAngle_Y, rotateAngle_Z);
+        glm::vec3 scale(scale_X, scale_Y, scale_Z);
+        scene.setPosition(modelNode, glm::vec3(translate_X, translate_Y, translate_Z));
+        scene.setPosition(cube1Node, glm::vec3(cube1_X, 0.0f, 0.0f));
+        scene.setPosition(cube2Node, glm::vec3(cube2_X, 0.0f, 0.0f));
+        scene.setRotation(cube1Node, rotation);
+        scene.setRotation(cube2Node, rotation);
+        scene.setScale(cube1Node, scale);
+        scene.setScale(cube2Node, scale);
+        sceneUpdated = scene.update();
+
+        // anything that moved or a new camera means the shown frame is stale
+        if (sceneUpdated > 0 || projection != shownProjection || view != shownView)
+            framePacer().requestRedraw();
+        if (!framePacer().beginFrame())
+        {
+            framePacer().report();
+            lastFrame += (float)framePacer().waitEvents();
+            continue;
+        }
+        shownProjection = projection;
+        shownView = view;
+
+        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // a single upload, whatever the number of programs
+        cameraBuffer.update(projection, view);
+
+        drawCube(ourShader, cube, scene.world(cube1Node));
+        drawCube(ourShader, cube2, scene.world(cube2Node));
+
+        drawCubesInstanced(constantInstancedShader, cube, &scene.world(axesNode), 2);
+
+        glState().endFrame();
+        statsTimer += deltaTime;
+        if (statsTimer >= 1.0f)
+        {
+            const GLStateCache::Counters& stats = glState().lastFrame;
+            logger().log("GL state: %u calls issued, %u redundant calls elided per frame", stats.issued, stats.elided);
+            logger().log("Scene: %d of %zu world matrices recomputed last frame", sceneUpdated, scene.size());
+            statsTimer = 0.0f;
+        }
 
-        drawAxes(constantShader, VAO, identityMatrix);
+        framePacer().report();
 
         glfwSwapBuffers(window);
-        glfwPollEvents();
+        lastFrame += (float)framePacer().waitEvents();
+
+        if (!firstFrameDrawn)
+        {
+            double startupMs = chrono::duration<double, milli>(chrono::steady_clock::now() - startupBegin).count();
+            logger().log("Startup: first complete frame after %g ms (%d programs from binary cache, %d compiled)",
+                startupMs, programs.stats.fromBinary, programs.stats.compiled);
+            firstFrameDrawn = true;
+        }
     }
 
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1, &EBO);
+    geometry.release();
+    glDeleteBuffers(1, &cameraBuffer.ID);
+    programs.release();
 
     glfwTerminate();
     return 0;
@@ -447,6 +557,7 @@ void processInput(GLFWwindow* window)
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
+    framePacer().requestRedraw();
 }
 
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
@@ -475,41 +586,135 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
     basic_camera.ProcessMouseScroll(static_cast<float>(yoffset));
 }
 
-void drawCube(Shader shaderProgram, unsigned int VAO, glm::mat4 parentTrans, float posX, float posY, float posZ, float rotX, float rotY, float rotZ, float scX, float scY, float scZ)
+void drawCube(const Shader& shaderProgram, const Mesh& mesh, const glm::mat4& model)
 {
     shaderProgram.use();
+    shaderProgram.set(uModel, model);
+
+    geometry.draw(mesh);
+}
 
-    glm::mat4 translateMatrix, rotateXMatrix, rotateYMatrix, rotateZMatrix, scaleMatrix, model, modelCentered;
+glm::mat4 cubeModel(const glm::mat4& parentTrans, float posX, float posY, float posZ, float rotX, float rotY, float rotZ, float scX, float scY, float scZ)
+{
+    glm::mat4 translateMatrix, rotateXMatrix, rotateYMatrix, rotateZMatrix, model;
     translateMatrix = glm::translate(parentTrans, glm::vec3(posX, posY, posZ));
     rotateXMatrix = glm::rotate(translateMatrix, glm::radians(rotX), glm::vec3(1.0f, 0.0f, 0.0f));
     rotateYMatrix = glm::rotate(rotateXMatrix, glm::radians(rotY), glm::vec3(0.0f, 1.0f, 0.0f));
     rotateZMatrix = glm::rotate(rotateYMatrix, glm::radians(rotZ), glm::vec3(0.0f, 0.0f, 1.0f));
     model = glm::scale(rotateZMatrix, glm::vec3(scX, scY, scZ));
-    modelCentered = glm::translate(model, glm::vec3(-0.25, -0.25, -0.25));
+    return glm::translate(model, glm::vec3(-0.25, -0.25, -0.25));
+}
 
-    shaderProgram.setMat4("model", modelCentered);
+// One draw call for any number of cubes: the model matrices go to the
+// instance buffer and the INSTANCED shader variant reads them per instance.
+void drawCubesInstanced(const Shader& shaderProgram, const Mesh& mesh, const glm::mat4* models, size_t count)
+{
+    if (count == 0)
+        return;
 
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    shaderProgram.use();
+    cubeInstances.upload(models, count);
+    geometry.drawInstanced(mesh, (GLsizei)count);
 }
 
-void drawAxes(Shader shaderProgram, unsigned int VAO, glm::mat4 parentTrans)
+// Renders a grid of `count` spinning cubes through drawCube() and through
+// drawCubesInstanced() and prints the average frame time of each. Both paths
+// rebuild every matrix each frame, so they only differ in how they submit.
+void runCubeStress(GLFWwindow* window, const Shader& perDrawShader, const Shader& instancedShader, const Mesh& mesh, CameraBuffer& cameraBuffer, int count)
 {
-    drawCube(shaderProgram, VAO, parentTrans, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 100.0, 0.1, 0.1);
-    drawCube(shaderProgram, VAO, parentTrans, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.1, 100.0, 0.1);
+    const int frames = 60;
+    const float spacing = 0.6f;
+    int side = (int)ceil(sqrt((double)count));
+    float extent = side * spacing;
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, extent * 4.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(extent * 0.5f, extent * 0.8f, extent * 1.4f),
+        glm::vec3(extent * 0.5f, 0.0f, extent * 0.5f), glm::vec3(0.0f, 1.0f, 0.0f));
+    cameraBuffer.update(projection, view);
+
+    // measure the work, not the display refresh
+    glfwSwapInterval(0);
+
+    vector<glm::mat4> models(count);
+    glm::mat4 identityMatrix = glm::mat4(1.0f);
+    double frameMs[2];
+    for (int path = 0; path < 2; path++)
+    {
+        glFinish();
+        auto start = chrono::steady_clock::now();
+        for (int frame = 0; frame < frames; frame++)
+        {
+            glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            float spin = frame * 3.0f;
+            for (int i = 0; i < count; i++)
+            {
+                float x = (i % side) * spacing;
+                float z = (i / side) * spacing;
+                glm::mat4 model = cubeModel(identityMatrix, x, 0.0f, z, 0.0f, spin, 0.0f, 1.0f, 1.0f, 1.0f);
+                if (path == 0)
+                    drawCube(perDrawShader, mesh, model);
+                else
+                    models[i] = model;
+            }
+            if (path == 1)
+                drawCubesInstanced(instancedShader, mesh, models.data(), models.size());
+
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+        glFinish();
+        frameMs[path] = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / frames;
+    }
+
+    cout << "Cube stress test: " << count << " cubes, " << frames << " frames per path" << endl;
+    cout << "  per-draw  : " << frameMs[0] << " ms/frame (" << count << " draw calls)" << endl;
+    cout << "  instanced : " << frameMs[1] << " ms/frame (1 draw call)" << endl;
+    cout << "  speedup   : " << frameMs[0] / frameMs[1] << "x" << endl;
+}
+
+// Times the string based setter against the pre-resolved handle for the
+// model matrix drawCube() uploads per draw. glFinish keeps queued driver
+// work from leaking into the next measurement.
+void benchmarkUniformSetters(const Shader& shaderProgram, int iterations)
+{
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 2.0f, 3.0f));
+
+    shaderProgram.use();
+    glFinish();
+
+    auto start = chrono::high_resolution_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        shaderProgram.setMat4("model", model);
+    }
+    glFinish();
+    auto mid = chrono::high_resolution_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        shaderProgram.set(uModel, model);
+    }
+    glFinish();
+    auto end = chrono::high_resolution_clock::now();
+
+    double sets = iterations;
+    double byName = chrono::duration<double, nano>(mid - start).count() / sets;
+    double byHandle = chrono::duration<double, nano>(end - mid).count() / sets;
+    cout << "Uniform setters (" << (int)sets << " sets of mat4)" << endl;
+    cout << "  setMat4(name)   : " << byName << " ns/set" << endl;
+    cout << "  set(handle)     : " << byHandle << " ns/set" << endl;
+    cout << "  speedup         : " << byName / byHandle << "x" << endl;
 }
 
 void printMatrix4(glm::mat4 matrix, string name)
 {
     if (!printMatNow) return;
-    cout << endl << endl << name << " Matrix Values:" << endl;
+    // queued for the logger thread, the frame never waits on the console
+    logger().log("\n\n%s Matrix Values:", name);
     for (int i = 0; i < 4; i++)
     {
-        for (int j = 0; j < 4; j++)
-        {
-            cout << matrix[i][j] << "\t";
-        }
-        cout << endl;
+        logger().log("%g\t%g\t%g\t%g\t", matrix[i][0], matrix[i][1], matrix[i][2], matrix[i][3]);
     }
 
     printMatNow = false;
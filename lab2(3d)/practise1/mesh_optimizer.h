@@ -0,0 +1,295 @@
+//
+//  mesh_optimizer.h
+//  3D Object Drawing
+//
+
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+
+// Average cache miss ratio: vertex shader invocations per triangle for a
+// FIFO post-transform cache of `cacheSize` entries. 3.0 means no reuse at
+// all; a regular grid can get close to 0.5.
+inline float computeACMR(const unsigned int* indices, size_t indexCount, size_t vertexCount, int cacheSize = 16)
+{
+    if (indexCount < 3)
+        return 0.0f;
+
+    // time stamp of the moment each vertex entered the cache
+    std::vector<size_t> enteredAt(vertexCount, 0);
+    size_t clock = (size_t)cacheSize + 1;
+    size_t misses = 0;
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        unsigned int v = indices[i];
+        if (clock - enteredAt[v] > (size_t)cacheSize)
+        {
+            enteredAt[v] = clock++;
+            misses++;
+        }
+    }
+    return (float)misses / (float)(indexCount / 3);
+}
+
+// Reorders triangles for the post-transform vertex cache with Tom Forsyth's
+// "linear-speed vertex cache optimisation": triangles are emitted greedily
+// by a score that favours vertices already in a simulated LRU cache and
+// vertices with few triangles left, so the fans left behind get finished.
+inline void optimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount)
+{
+    const int CACHE_SIZE = 32;
+    const float CACHE_DECAY_POWER = 1.5f;
+    const float LAST_TRIANGLE_SCORE = 0.75f;
+    const float VALENCE_BOOST_SCALE = 2.0f;
+    const float VALENCE_BOOST_POWER = 0.5f;
+
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return;
+
+    // triangles using each vertex, as offsets into one array
+    std::vector<unsigned int> remaining(vertexCount, 0);
+    for (size_t i = 0; i < indexCount; i++)
+        remaining[indices[i]]++;
+    std::vector<size_t> firstTriangle(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+    std::vector<unsigned int> vertexTriangles(indexCount);
+    std::vector<size_t> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        for (int k = 0; k < 3; k++)
+            vertexTriangles[filled[indices[t * 3 + k]]++] = (unsigned int)t;
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount, 0.0f);
+    auto scoreVertex = [&](unsigned int v) -> float
+    {
+        if (remaining[v] == 0)
+            return -1.0f;
+        float score = 0.0f;
+        int position = cachePosition[v];
+        if (position >= 0)
+        {
+            if (position < 3)
+                score = LAST_TRIANGLE_SCORE;
+            else
+                score = std::pow(1.0f - (float)(position - 3) / (CACHE_SIZE - 3), CACHE_DECAY_POWER);
+        }
+        return score + VALENCE_BOOST_SCALE * std::pow((float)remaining[v], -VALENCE_BOOST_POWER);
+    };
+    for (size_t v = 0; v < vertexCount; v++)
+        vertexScore[v] = scoreVertex((unsigned int)v);
+
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; t++)
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+    std::vector<unsigned int> result;
+    result.reserve(indexCount);
+    std::vector<unsigned int> cache, nextCache;
+    long long best = -1;
+
+    for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+    {
+        if (best < 0)
+        {
+            // nothing scored in the cache neighbourhood: full scan
+            float bestScore = -1.0f;
+            for (size_t t = 0; t < triangleCount; t++)
+            {
+                if (!emitted[t] && triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    best = (long long)t;
+                }
+            }
+        }
+
+        size_t t = (size_t)best;
+        emitted[t] = true;
+        const unsigned int* corners = indices + t * 3;
+        result.insert(result.end(), corners, corners + 3);
+
+        // drop the triangle from its vertices' lists
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v = corners[k];
+            size_t begin = firstTriangle[v];
+            size_t end = begin + remaining[v];
+            for (size_t i = begin; i < end; i++)
+            {
+                if (vertexTriangles[i] == t)
+                {
+                    vertexTriangles[i] = vertexTriangles[end - 1];
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+
+        // the triangle's vertices move to the front of the LRU cache
+        nextCache.assign(corners, corners + 3);
+        for (unsigned int v : cache)
+        {
+            if (v != corners[0] && v != corners[1] && v != corners[2])
+                nextCache.push_back(v);
+        }
+        for (size_t i = 0; i < nextCache.size(); i++)
+            cachePosition[nextCache[i]] = i < (size_t)CACHE_SIZE ? (int)i : -1;
+
+        // rescore what the cache touched and pick the next triangle among them
+        best = -1;
+        float bestScore = -1.0f;
+        for (unsigned int v : nextCache)
+        {
+            vertexScore[v] = scoreVertex(v);
+            size_t begin = firstTriangle[v];
+            size_t end = begin + remaining[v];
+            for (size_t i = begin; i < end; i++)
+            {
+                unsigned int u = vertexTriangles[i];
+                const unsigned int* c = indices + (size_t)u * 3;
+                triangleScore[u] = vertexScore[c[0]] + vertexScore[c[1]] + vertexScore[c[2]];
+                if (triangleScore[u] > bestScore)
+                {
+                    bestScore = triangleScore[u];
+                    best = u;
+                }
+            }
+        }
+
+        if (nextCache.size() > (size_t)CACHE_SIZE)
+            nextCache.resize(CACHE_SIZE);
+        cache.swap(nextCache);
+    }
+
+    for (size_t i = 0; i < indexCount; i++)
+        indices[i] = result[i];
+}
+
+// Renumbers vertices in the order the index buffer first uses them, so the
+// vertex fetch walks memory forwards. Unreferenced vertices are dropped.
+// Returns the new vertex count.
+inline size_t optimizeVertexFetch(std::vector<float>& vertices, size_t floatsPerVertex, std::vector<unsigned int>& indices)
+{
+    size_t vertexCount = vertices.size() / floatsPerVertex;
+    const unsigned int UNUSED = 0xFFFFFFFFu;
+    std::vector<unsigned int> remap(vertexCount, UNUSED);
+    std::vector<float> reordered;
+    reordered.reserve(vertices.size());
+
+    unsigned int next = 0;
+    for (unsigned int& index : indices)
+    {
+        if (remap[index] == UNUSED)
+        {
+            remap[index] = next++;
+            const float* vertex = &vertices[(size_t)index * floatsPerVertex];
+            reordered.insert(reordered.end(), vertex, vertex + floatsPerVertex);
+        }
+        index = remap[index];
+    }
+    vertices.swap(reordered);
+    return next;
+}
+
+// Turns position-only vertices of a convex mesh into position + normal
+// (6 floats). The primitives are not wound consistently, so every face
+// normal is turned away from the centroid first. A corner's normal averages
+// the faces around its vertex that lie within `creaseDegrees` of its own
+// face, which keeps cylinder sides smooth and cube edges sharp; a vertex is
+// split once per distinct normal.
+inline void generateNormals(std::vector<float>& vertices, std::vector<unsigned int>& indices, float creaseDegrees = 50.0f)
+{
+    size_t vertexCount = vertices.size() / 3;
+    size_t triangleCount = indices.size() / 3;
+    if (vertexCount == 0 || triangleCount == 0)
+        return;
+
+    float centroid[3] = { 0.0f, 0.0f, 0.0f };
+    for (size_t v = 0; v < vertexCount; v++)
+        for (int k = 0; k < 3; k++)
+            centroid[k] += vertices[v * 3 + k] / vertexCount;
+
+    std::vector<float> faceNormals(triangleCount * 3, 0.0f);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        const float* a = &vertices[indices[t * 3] * 3];
+        const float* b = &vertices[indices[t * 3 + 1] * 3];
+        const float* c = &vertices[indices[t * 3 + 2] * 3];
+        float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+        float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length == 0.0f)
+            continue;
+
+        // a flat mesh has its centroid in the plane and keeps its winding
+        float outward = 0.0f;
+        for (int k = 0; k < 3; k++)
+            outward += n[k] * ((a[k] + b[k] + c[k]) / 3.0f - centroid[k]);
+        float sign = outward < -1e-6f * length ? -1.0f : 1.0f;
+        for (int k = 0; k < 3; k++)
+            faceNormals[t * 3 + k] = sign * n[k] / length;
+    }
+
+    // triangles using each vertex, as offsets into one array
+    std::vector<size_t> firstTriangle(vertexCount + 1, 0);
+    for (unsigned int index : indices)
+        firstTriangle[index + 1]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        firstTriangle[v + 1] += firstTriangle[v];
+    std::vector<unsigned int> vertexTriangles(indices.size());
+    std::vector<size_t> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+        vertexTriangles[filled[indices[i]]++] = (unsigned int)(i / 3);
+
+    const float cosCrease = std::cos(creaseDegrees * 3.14159265f / 180.0f);
+    std::vector<float> result;
+    result.reserve(vertices.size() * 2);
+    std::vector<std::vector<unsigned int>> outputsOf(vertexCount);   // output vertices split off each input one
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        unsigned int v = indices[i];
+        const float* own = &faceNormals[(i / 3) * 3];
+        float n[3] = { 0.0f, 0.0f, 0.0f };
+        for (size_t j = firstTriangle[v]; j < firstTriangle[v + 1]; j++)
+        {
+            const float* other = &faceNormals[vertexTriangles[j] * 3];
+            if (own[0] * other[0] + own[1] * other[1] + own[2] * other[2] >= cosCrease)
+                for (int k = 0; k < 3; k++)
+                    n[k] += other[k];
+        }
+        float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        for (int k = 0; k < 3; k++)
+            n[k] = length > 0.0f ? n[k] / length : own[k];
+
+        unsigned int output = 0xFFFFFFFFu;
+        for (unsigned int candidate : outputsOf[v])
+        {
+            const float* m = &result[(size_t)candidate * 6 + 3];
+            if (std::fabs(m[0] - n[0]) + std::fabs(m[1] - n[1]) + std::fabs(m[2] - n[2]) < 1e-4f)
+            {
+                output = candidate;
+                break;
+            }
+        }
+        if (output == 0xFFFFFFFFu)
+        {
+            output = (unsigned int)(result.size() / 6);
+            result.insert(result.end(), &vertices[(size_t)v * 3], &vertices[(size_t)v * 3] + 3);
+            result.insert(result.end(), n, n + 3);
+            outputsOf[v].push_back(output);
+        }
+        indices[i] = output;
+    }
+    vertices.swap(result);
+}
+
+#endif
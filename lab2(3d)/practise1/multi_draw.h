@@ -0,0 +1,107 @@
+//
+//  multi_draw.h
+//  3D Object Drawing
+//
+
+#ifndef MULTI_DRAW_H
+#define MULTI_DRAW_H
+
+#include <glad/glad.h>
+
+#include "gl_state.h"
+#include "gl_extensions.h"
+#include "geometry_pool.h"
+#include "instance_buffer.h"
+
+#include <vector>
+#include <iostream>
+
+// layout of one record in GL_DRAW_INDIRECT_BUFFER for glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// Collects draws of GeometryPool meshes, each with its own {model, colour},
+// and submits all of them with one glMultiDrawElementsIndirect. The
+// per-draw records go to a shader storage buffer at DRAW_DATA_BINDING that
+// the vertex shader indexes with gl_DrawIDARB (std430, same layout as
+// ColoredInstance). Only usable when glExt().multiDrawIndirect and
+// glExt().shaderDrawParameters are both set; callers keep another path.
+class MultiDrawBuffer
+{
+public:
+    static const GLuint DRAW_DATA_BINDING = 0;
+
+    unsigned int commandBuffer = 0;
+    unsigned int drawDataBuffer = 0;
+
+    // gl_DrawID restarts with every call, so one submit can only cover
+    // meshes sharing an index type
+    void add(const Mesh& mesh, const ColoredInstance& data)
+    {
+        if (commands.empty())
+            indexType = mesh.indexType;
+        else if (mesh.indexType != indexType)
+        {
+            std::cout << "ERROR::MULTI_DRAW::MIXED_INDEX_TYPES" << std::endl;
+            return;
+        }
+
+        DrawElementsIndirectCommand command;
+        command.count = (GLuint)mesh.count;
+        command.instanceCount = 1;
+        command.firstIndex = mesh.firstIndex;
+        command.baseVertex = mesh.baseVertex;
+        command.baseInstance = 0;
+        commands.push_back(command);
+        drawData.push_back(data);
+    }
+
+    size_t size() const
+    {
+        return commands.size();
+    }
+
+    void submit(const GeometryPool& pool)
+    {
+        if (commands.empty())
+            return;
+        if (commandBuffer == 0)
+        {
+            glGenBuffers(1, &commandBuffer);
+            glGenBuffers(1, &drawDataBuffer);
+        }
+
+        // orphan both buffers, as InstanceBuffer does
+        glState().bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+        glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, drawDataBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, drawData.size() * sizeof(ColoredInstance), drawData.data(), GL_STREAM_DRAW);
+        glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, drawDataBuffer);
+
+        pool.bind();
+        glExt().multiDrawElementsIndirect(GL_TRIANGLES, indexType, (void*)0, (GLsizei)commands.size(), 0);
+
+        commands.clear();
+        drawData.clear();
+    }
+
+    void release()
+    {
+        glDeleteBuffers(1, &commandBuffer);
+        glDeleteBuffers(1, &drawDataBuffer);
+        commandBuffer = drawDataBuffer = 0;
+    }
+
+private:
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<ColoredInstance> drawData;
+    GLenum indexType = GL_UNSIGNED_SHORT;
+};
+
+#endif
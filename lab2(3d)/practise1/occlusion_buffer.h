@@ -0,0 +1,288 @@
+//
+//  occlusion_buffer.h
+//  3D Object Drawing
+//
+
+#ifndef OCCLUSION_BUFFER_H
+#define OCCLUSION_BUFFER_H
+
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// Small CPU depth buffer for occlusion culling, after "Masked Software
+// Occlusion Culling" (Hasselgren, Andersson, Akenine-Möller 2016). Pixels
+// are grouped in 8x4 tiles and a tile stores no per-pixel depth: only a
+// 32-bit coverage mask and two conservative far depths, zMax0 for the
+// whole tile and zMax1 for the pixels in the mask. Occluders are boxes
+// that lie entirely inside solid geometry; each triangle is rasterised four
+// pixels per SSE instruction and merged with its farthest vertex depth, so
+// the buffer never claims more than the real geometry hides. Depth is the
+// view distance (clip w).
+class MaskedOcclusionBuffer
+{
+public:
+    static const int TILE_WIDTH = 8;
+    static const int TILE_HEIGHT = 4;
+
+    struct Stats
+    {
+        int occluders = 0;      // boxes rasterised
+        int triangles = 0;
+        int tested = 0;         // boxes tested against the buffer
+        int occluded = 0;       // of those, proven hidden
+    };
+    Stats stats;
+
+    void resize(int pixelsWide, int pixelsHigh)
+    {
+        tilesX = (pixelsWide + TILE_WIDTH - 1) / TILE_WIDTH;
+        tilesY = (pixelsHigh + TILE_HEIGHT - 1) / TILE_HEIGHT;
+        width = tilesX * TILE_WIDTH;
+        height = tilesY * TILE_HEIGHT;
+        tiles.resize(tilesX * tilesY);
+    }
+
+    // Clears the buffer for a new frame seen through viewProj from eye.
+    void begin(const glm::mat4& viewProj, const glm::vec3& eye)
+    {
+        matrix = viewProj;
+        camera = eye;
+        for (Tile& tile : tiles)
+        {
+            tile.zMax0 = FLT_MAX;
+            tile.zMax1 = 0.0f;
+            tile.mask = 0;
+        }
+        stats = Stats();
+    }
+
+    // Rasterises the faces of `box` that face the camera. The box has to be
+    // inside solid geometry; boxes reaching behind the near plane are
+    // skipped rather than clipped.
+    void renderBox(const AABB& box)
+    {
+        ScreenVertex corners[8];
+        if (!project(box, corners))
+            return;
+        stats.occluders++;
+
+        // corner index bits: 1 = max x, 2 = max y, 4 = max z
+        static const int FACES[6][4] = {
+            {0, 2, 6, 4}, {1, 3, 7, 5},     // -x, +x
+            {0, 1, 5, 4}, {2, 3, 7, 6},     // -y, +y
+            {0, 1, 3, 2}, {4, 5, 7, 6}      // -z, +z
+        };
+        for (int axis = 0; axis < 3; axis++)
+        {
+            int face;
+            if (camera[axis] < box.min[axis])
+                face = axis * 2;
+            else if (camera[axis] > box.max[axis])
+                face = axis * 2 + 1;
+            else
+                continue;
+            const int* f = FACES[face];
+            rasterizeTriangle(corners[f[0]], corners[f[1]], corners[f[2]]);
+            rasterizeTriangle(corners[f[0]], corners[f[2]], corners[f[3]]);
+        }
+    }
+
+    // False only when every pixel the box's screen rectangle touches is
+    // known to be covered by something nearer than the box's nearest point.
+    bool testBox(const AABB& box)
+    {
+        return testBox(box, stats);
+    }
+
+    // Same, counting into `counters`: the buffer is only read, so threads
+    // may test against it at once as long as each has its own counters.
+    bool testBox(const AABB& box, Stats& counters) const
+    {
+        ScreenVertex corners[8];
+        if (!project(box, corners))
+            return true;
+
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, nearest = FLT_MAX;
+        for (const ScreenVertex& v : corners)
+        {
+            minX = std::min(minX, v.x);
+            maxX = std::max(maxX, v.x);
+            minY = std::min(minY, v.y);
+            maxY = std::max(maxY, v.y);
+            nearest = std::min(nearest, v.w);
+        }
+        int x0 = std::max(0, (int)std::floor(minX)), x1 = std::min(width - 1, (int)std::floor(maxX));
+        int y0 = std::max(0, (int)std::floor(minY)), y1 = std::min(height - 1, (int)std::floor(maxY));
+        if (x0 > x1 || y0 > y1)
+            return true;    // off screen: the frustum test decides that
+        counters.tested++;
+
+        for (int ty = y0 / TILE_HEIGHT; ty <= y1 / TILE_HEIGHT; ty++)
+        {
+            int rowLow = std::max(y0 - ty * TILE_HEIGHT, 0), rowHigh = std::min(y1 - ty * TILE_HEIGHT, TILE_HEIGHT - 1);
+            for (int tx = x0 / TILE_WIDTH; tx <= x1 / TILE_WIDTH; tx++)
+            {
+                int low = std::max(x0 - tx * TILE_WIDTH, 0), high = std::min(x1 - tx * TILE_WIDTH, TILE_WIDTH - 1);
+                unsigned int rowBits = (0xFFu >> (7 - high)) & (0xFFu << low);
+                unsigned int rect = 0;
+                for (int r = rowLow; r <= rowHigh; r++)
+                    rect |= rowBits << (r * TILE_WIDTH);
+
+                const Tile& tile = tiles[ty * tilesX + tx];
+                if ((rect & tile.mask) && nearest <= tile.zMax1)
+                    return true;
+                if ((rect & ~tile.mask) && nearest <= tile.zMax0)
+                    return true;
+            }
+        }
+        counters.occluded++;
+        return false;
+    }
+
+private:
+    struct Tile
+    {
+        float zMax0;
+        float zMax1;
+        unsigned int mask;   // bit r * 8 + c: pixel in row r, column c
+    };
+
+    struct ScreenVertex
+    {
+        float x, y, w;
+    };
+
+    // clip w below which a box counts as crossing the near plane
+    static constexpr float NEAR_W = 1e-3f;
+
+    std::vector<Tile> tiles;
+    int tilesX = 0, tilesY = 0;
+    int width = 0, height = 0;
+    glm::mat4 matrix = glm::mat4(1.0f);
+    glm::vec3 camera = glm::vec3(0.0f);
+
+    bool project(const AABB& box, ScreenVertex* out) const
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            glm::vec4 corner((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y, (i & 4) ? box.max.z : box.min.z, 1.0f);
+            glm::vec4 clip = matrix * corner;
+            if (clip.w < NEAR_W)
+                return false;
+            out[i].x = (clip.x / clip.w * 0.5f + 0.5f) * width;
+            out[i].y = (clip.y / clip.w * 0.5f + 0.5f) * height;
+            out[i].w = clip.w;
+        }
+        return true;
+    }
+
+    void rasterizeTriangle(ScreenVertex a, ScreenVertex b, ScreenVertex c)
+    {
+        float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+        if (std::fabs(area) < 1e-6f)
+            return;
+        if (area < 0.0f)
+            std::swap(b, c);
+        float depth = std::max(a.w, std::max(b.w, c.w));
+
+        int x0 = std::max(0, (int)std::floor(std::min(a.x, std::min(b.x, c.x))));
+        int x1 = std::min(width - 1, (int)std::floor(std::max(a.x, std::max(b.x, c.x))));
+        int y0 = std::max(0, (int)std::floor(std::min(a.y, std::min(b.y, c.y))));
+        int y1 = std::min(height - 1, (int)std::floor(std::max(a.y, std::max(b.y, c.y))));
+        if (x0 > x1 || y0 > y1)
+            return;
+        stats.triangles++;
+
+        // E(x, y) = A x + B y + C, non-negative inside for a CCW triangle
+        const ScreenVertex* v[3] = {&a, &b, &c};
+        float A[3], B[3], C[3];
+        for (int e = 0; e < 3; e++)
+        {
+            const ScreenVertex& p = *v[e];
+            const ScreenVertex& q = *v[(e + 1) % 3];
+            A[e] = -(q.y - p.y);
+            B[e] = q.x - p.x;
+            C[e] = -(A[e] * p.x + B[e] * p.y);
+        }
+
+        for (int ty = y0 / TILE_HEIGHT; ty <= y1 / TILE_HEIGHT; ty++)
+        {
+            for (int tx = x0 / TILE_WIDTH; tx <= x1 / TILE_WIDTH; tx++)
+            {
+                unsigned int mask = coverage(A, B, C, tx * TILE_WIDTH + 0.5f, ty * TILE_HEIGHT + 0.5f);
+                if (mask)
+                    merge(tiles[ty * tilesX + tx], mask, depth);
+            }
+        }
+    }
+
+    // Coverage of the 8x4 pixel centres starting at (left, top)
+    static unsigned int coverage(const float* A, const float* B, const float* C, float left, float top)
+    {
+        unsigned int mask = 0;
+#ifdef BVH_SSE
+        const __m128 zero = _mm_setzero_ps();
+        __m128 xs0 = _mm_add_ps(_mm_set1_ps(left), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+        __m128 xs1 = _mm_add_ps(xs0, _mm_set1_ps(4.0f));
+        __m128 ax0[3], ax1[3];
+        for (int e = 0; e < 3; e++)
+        {
+            __m128 a = _mm_set1_ps(A[e]);
+            ax0[e] = _mm_mul_ps(a, xs0);
+            ax1[e] = _mm_mul_ps(a, xs1);
+        }
+        for (int r = 0; r < TILE_HEIGHT; r++)
+        {
+            float y = top + r;
+            __m128 inside0 = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            __m128 inside1 = inside0;
+            for (int e = 0; e < 3; e++)
+            {
+                __m128 rowConstant = _mm_set1_ps(B[e] * y + C[e]);
+                inside0 = _mm_and_ps(inside0, _mm_cmpge_ps(_mm_add_ps(ax0[e], rowConstant), zero));
+                inside1 = _mm_and_ps(inside1, _mm_cmpge_ps(_mm_add_ps(ax1[e], rowConstant), zero));
+            }
+            unsigned int bits = (unsigned int)_mm_movemask_ps(inside0) | ((unsigned int)_mm_movemask_ps(inside1) << 4);
+            mask |= bits << (r * TILE_WIDTH);
+        }
+#else
+        for (int r = 0; r < TILE_HEIGHT; r++)
+        {
+            float y = top + r;
+            for (int i = 0; i < TILE_WIDTH; i++)
+            {
+                float x = left + i;
+                if (A[0] * x + B[0] * y + C[0] >= 0.0f && A[1] * x + B[1] * y + C[1] >= 0.0f && A[2] * x + B[2] * y + C[2] >= 0.0f)
+                    mask |= 1u << (r * TILE_WIDTH + i);
+            }
+        }
+#endif
+        return mask;
+    }
+
+    // Adds `mask` at `depth` to the working layer. A triangle nearer to the
+    // reference depth than to the working layer starts a new working layer;
+    // once the working layer covers the tile it becomes the reference.
+    static void merge(Tile& tile, unsigned int mask, float depth)
+    {
+        if (depth >= tile.zMax0)
+            return;
+        if (tile.mask && depth - tile.zMax1 > tile.zMax0 - depth)
+            tile.mask = 0;
+        tile.zMax1 = tile.mask ? std::max(tile.zMax1, depth) : depth;
+        tile.mask |= mask;
+        if (tile.mask == 0xFFFFFFFFu)
+        {
+            tile.zMax0 = tile.zMax1;
+            tile.mask = 0;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,225 @@
+//
+//  program_cache.h
+//  3D Object Drawing
+//
+
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+
+#include "shader.h"
+#include "shader_preprocessor.h"
+#include "gl_extensions.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// Owns every shader program of the application, keyed by a hash of the
+// driver, the preprocessed sources and the feature bits they were built with.
+// A request first tries the program binary saved under the cache directory;
+// otherwise the program is compiled in the background and written to the
+// cache once it links. Callers poll() each frame and skip drawing with a
+// program until isReady() says so, so compiles never stall a frame.
+class ProgramCache
+{
+public:
+    struct Stats
+    {
+        int fromBinary = 0;
+        int compiled = 0;
+    };
+
+    Stats stats;
+
+    explicit ProgramCache(const std::string& directory = "shader_cache") : directory(directory)
+    {
+#ifdef _WIN32
+        _mkdir(directory.c_str());
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+    }
+
+    // Returns the program variant for these sources and ShaderFeature bits.
+    // The reference stays valid for the lifetime of the cache; repeated
+    // requests for the same variant return the same Shader.
+    Shader& request(const char* vertexPath, const char* fragmentPath, unsigned int features = 0)
+    {
+        ShaderPreprocessor preprocessor;
+        std::string vertexCode = preprocessor.process(vertexPath, features);
+        std::string fragmentCode = preprocessor.process(fragmentPath, features);
+
+        uint64_t key = hashSources(vertexCode, fragmentCode, features);
+        for (Entry& entry : entries)
+        {
+            if (entry.key == key)
+                return *entry.shader;
+        }
+
+        entries.push_back(Entry());
+        Entry& entry = entries.back();
+        entry.key = key;
+        entry.shader.reset(new Shader());
+
+        if (loadFromDisk(entry))
+        {
+            stats.fromBinary++;
+            entry.saved = true;
+        }
+        else
+        {
+            entry.shader->compile(vertexCode, fragmentCode);
+            stats.compiled++;
+        }
+        return *entry.shader;
+    }
+
+    // Finishes builds the driver has completed and stores their binaries.
+    // Returns how many programs are still compiling.
+    int poll()
+    {
+        int pending = 0;
+        for (Entry& entry : entries)
+        {
+            if (!entry.shader->isReady())
+            {
+                pending++;
+                continue;
+            }
+            if (!entry.saved)
+            {
+                saveToDisk(entry);
+                entry.saved = true;
+            }
+        }
+        return pending;
+    }
+
+    // Blocks until every requested program is built.
+    void finishAll()
+    {
+        for (Entry& entry : entries)
+            entry.shader->finish();
+        poll();
+    }
+
+    void release()
+    {
+        for (Entry& entry : entries)
+            glDeleteProgram(entry.shader->ID);
+        entries.clear();
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t key = 0;
+        std::unique_ptr<Shader> shader;
+        bool saved = false;
+    };
+
+    // header in front of every cached blob
+    struct BinaryHeader
+    {
+        uint32_t magic;
+        uint32_t format;
+        uint32_t length;
+    };
+
+    static const uint32_t BINARY_MAGIC = 0x42504C47;  // "GLPB"
+
+    std::string directory;
+    std::vector<Entry> entries;
+
+    static uint64_t fnv1a(uint64_t hash, const char* data, size_t length)
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            hash ^= (unsigned char)data[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static uint64_t fnv1a(uint64_t hash, const std::string& text)
+    {
+        // the terminator keeps ("ab", "c") and ("a", "bc") apart
+        return fnv1a(hash, text.c_str(), text.size() + 1);
+    }
+
+    // Binaries only load on the driver that produced them, so it is part of the key.
+    static uint64_t hashSources(const std::string& vertexCode, const std::string& fragmentCode, unsigned int features)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        const GLenum driverStrings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+        for (GLenum name : driverStrings)
+        {
+            const char* value = (const char*)glGetString(name);
+            hash = fnv1a(hash, value ? value : "");
+        }
+        hash = fnv1a(hash, vertexCode);
+        hash = fnv1a(hash, fragmentCode);
+        hash = fnv1a(hash, (const char*)&features, sizeof(features));
+        return hash;
+    }
+
+    std::string pathFor(uint64_t key) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return directory + "/" + name;
+    }
+
+    bool loadFromDisk(Entry& entry)
+    {
+        if (!glExt().programBinary)
+            return false;
+
+        std::ifstream file(pathFor(entry.key), std::ios::binary);
+        if (!file.is_open())
+            return false;
+
+        BinaryHeader header;
+        if (!file.read((char*)&header, sizeof(header)) || header.magic != BINARY_MAGIC)
+            return false;
+        std::vector<char> binary(header.length);
+        if (!file.read(binary.data(), header.length))
+            return false;
+
+        if (!entry.shader->loadBinary((GLenum)header.format, binary.data(), (GLsizei)binary.size()))
+        {
+            std::cout << "Program binary " << pathFor(entry.key) << " was rejected by the driver, recompiling" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    void saveToDisk(const Entry& entry) const
+    {
+        GLenum format = 0;
+        std::vector<char> binary;
+        if (!entry.shader->getBinary(format, binary))
+            return;
+
+        std::ofstream file(pathFor(entry.key), std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+            return;
+        BinaryHeader header = { BINARY_MAGIC, (uint32_t)format, (uint32_t)binary.size() };
+        file.write((const char*)&header, sizeof(header));
+        file.write(binary.data(), binary.size());
+    }
+};
+
+#endif
@@ -0,0 +1,172 @@
+//
+//  pvs.h
+//  3D Object Drawing
+//
+
+#ifndef PVS_H
+#define PVS_H
+
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+// Potentially visible set over up to 64 box-shaped cells. build() decides
+// once which cells can see which: a grid of sample points is laid into
+// every cell and two cells see each other when any segment between their
+// samples misses all the blockers (boxes of solid geometry). Each cell then
+// keeps the cells it sees as one 64-bit mask, and at draw time an object is
+// kept when its own cell mask meets the mask of the camera's cell. Sampling
+// can miss a sliver of visibility, so blockers should be the solid cores of
+// walls rather than their full extent.
+class PotentiallyVisibleSet
+{
+public:
+    static const int MAX_CELLS = 64;
+
+    struct Stats
+    {
+        int cells = 0;
+        int visiblePairs = 0;       // ordered pairs, a cell sees itself
+        long long segmentsTested = 0;
+    };
+
+    Stats build(const std::vector<AABB>& cellBoxes, const std::vector<AABB>& blockers, int samplesPerAxis = 4)
+    {
+        Stats stats;
+        cells.assign(cellBoxes.begin(), cellBoxes.begin() + std::min(cellBoxes.size(), (size_t)MAX_CELLS));
+        visible.assign(cells.size(), 0);
+        stats.cells = (int)cells.size();
+
+        std::vector<std::vector<glm::vec3>> samples(cells.size());
+        for (size_t c = 0; c < cells.size(); c++)
+        {
+            glm::vec3 size = cells[c].max - cells[c].min;
+            for (int i = 0; i < samplesPerAxis; i++)
+                for (int j = 0; j < samplesPerAxis; j++)
+                    for (int k = 0; k < samplesPerAxis; k++)
+                    {
+                        glm::vec3 t((i + 0.5f) / samplesPerAxis, (j + 0.5f) / samplesPerAxis, (k + 0.5f) / samplesPerAxis);
+                        samples[c].push_back(cells[c].min + t * size);
+                    }
+        }
+
+        for (size_t a = 0; a < cells.size(); a++)
+        {
+            visible[a] |= 1ull << a;
+            for (size_t b = a + 1; b < cells.size(); b++)
+            {
+                if (canSee(samples[a], samples[b], blockers, stats.segmentsTested))
+                {
+                    visible[a] |= 1ull << b;
+                    visible[b] |= 1ull << a;
+                }
+            }
+        }
+        for (uint64_t mask : visible)
+        {
+            for (; mask; mask &= mask - 1)
+                stats.visiblePairs++;
+        }
+        return stats;
+    }
+
+    size_t cellCount() const
+    {
+        return cells.size();
+    }
+
+    // -1 when the point is in no cell
+    int cellAt(const glm::vec3& point) const
+    {
+        for (size_t c = 0; c < cells.size(); c++)
+        {
+            const AABB& cell = cells[c];
+            bool inside = true;
+            for (int axis = 0; axis < 3; axis++)
+                inside = inside && point[axis] >= cell.min[axis] && point[axis] < cell.max[axis];
+            if (inside)
+                return (int)c;
+        }
+        return -1;
+    }
+
+    uint64_t visibleFrom(int cell) const
+    {
+        return visible[cell];
+    }
+
+    // Cells a box overlaps; 0 for a box outside all of them
+    uint64_t cellsOverlapping(const AABB& box) const
+    {
+        uint64_t mask = 0;
+        for (size_t c = 0; c < cells.size(); c++)
+        {
+            const AABB& cell = cells[c];
+            bool overlaps = true;
+            for (int axis = 0; axis < 3; axis++)
+                overlaps = overlaps && box.min[axis] <= cell.max[axis] && box.max[axis] >= cell.min[axis];
+            if (overlaps)
+                mask |= 1ull << c;
+        }
+        return mask;
+    }
+
+private:
+    std::vector<AABB> cells;
+    std::vector<uint64_t> visible;
+
+    static bool canSee(const std::vector<glm::vec3>& from, const std::vector<glm::vec3>& to,
+        const std::vector<AABB>& blockers, long long& segmentsTested)
+    {
+        for (const glm::vec3& p : from)
+        {
+            for (const glm::vec3& q : to)
+            {
+                segmentsTested++;
+                bool blocked = false;
+                for (const AABB& blocker : blockers)
+                {
+                    if (segmentHits(p, q, blocker))
+                    {
+                        blocked = true;
+                        break;
+                    }
+                }
+                if (!blocked)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    // slab test of the segment p..q against a box
+    static bool segmentHits(const glm::vec3& p, const glm::vec3& q, const AABB& box)
+    {
+        float enter = 0.0f, leave = 1.0f;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float d = q[axis] - p[axis];
+            if (d == 0.0f)
+            {
+                if (p[axis] < box.min[axis] || p[axis] > box.max[axis])
+                    return false;
+                continue;
+            }
+            float t0 = (box.min[axis] - p[axis]) / d;
+            float t1 = (box.max[axis] - p[axis]) / d;
+            if (t0 > t1)
+                std::swap(t0, t1);
+            enter = std::max(enter, t0);
+            leave = std::min(leave, t1);
+            if (enter > leave)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
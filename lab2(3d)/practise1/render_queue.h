@@ -0,0 +1,169 @@
+//
+//  render_queue.h
+//  3D Object Drawing
+//
+
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glm/glm.hpp>
+
+#include "geometry_pool.h"
+#include "instance_buffer.h"
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+// Deferred submission of opaque GeometryPool draws. Each draw is queued as
+// a packed 64-bit sort key plus a payload (mesh and {model, colour}); the
+// keys are radix sorted once per frame and the caller replays the queue in
+// that order. The key fields, most significant first:
+//
+//   63..56 program    55..48 VAO    47..32 material    31..0 view depth
+//
+// so draws sharing a program, then a VAO, then a material end up next to
+// each other and state only changes between runs. Inside a run the depth
+// puts the nearest surfaces first, which lets the depth test throw away the
+// fragments behind them before they are shaded. Equal keys keep the order
+// they were queued in.
+class RenderQueue
+{
+public:
+    static const int STATE_SHIFT = 32;
+
+    static uint64_t makeKey(unsigned int program, unsigned int vao, unsigned int material, float depth)
+    {
+        return ((uint64_t)(program & 0xFF) << 56) | ((uint64_t)(vao & 0xFF) << 48) |
+            ((uint64_t)(material & 0xFFFF) << STATE_SHIFT) | depthBits(depth);
+    }
+
+    static unsigned int programOf(uint64_t key) { return (unsigned int)(key >> 56) & 0xFF; }
+    static unsigned int vaoOf(uint64_t key) { return (unsigned int)(key >> 48) & 0xFF; }
+    static unsigned int materialOf(uint64_t key) { return (unsigned int)(key >> STATE_SHIFT) & 0xFFFF; }
+
+    // distance in front of the camera, what the depth field orders by
+    static float viewDepth(const glm::mat4& view, const glm::vec3& point)
+    {
+        return -(view[0][2] * point.x + view[1][2] * point.y + view[2][2] * point.z + view[3][2]);
+    }
+
+    void clear()
+    {
+        entries.clear();
+        meshes.clear();
+        instances.clear();
+    }
+
+    void add(uint64_t key, const Mesh& mesh, const ColoredInstance& instance)
+    {
+        entries.push_back({ key, (uint32_t)instances.size() });
+        meshes.push_back(&mesh);
+        instances.push_back(instance);
+    }
+
+    // LSD radix sort of the keys, a byte per pass. A pass whose byte is the
+    // same in every key is skipped, which with a handful of programs and
+    // materials is most of the high ones. Then the payloads are put in key
+    // order so runs are contiguous for upload.
+    void sort()
+    {
+        size_t count = entries.size();
+        scratch.resize(count);
+        for (int shift = 0; shift < 64; shift += 8)
+        {
+            size_t histogram[256] = {};
+            for (const Entry& entry : entries)
+                histogram[(entry.key >> shift) & 0xFF]++;
+            if (histogram[(entries.empty() ? 0 : entries[0].key >> shift) & 0xFF] == count)
+                continue;
+
+            size_t offset = 0;
+            for (size_t& bucket : histogram)
+            {
+                size_t size = bucket;
+                bucket = offset;
+                offset += size;
+            }
+            for (const Entry& entry : entries)
+                scratch[histogram[(entry.key >> shift) & 0xFF]++] = entry;
+            entries.swap(scratch);
+        }
+
+        sortedMeshes.resize(count);
+        sortedInstances.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            sortedMeshes[i] = meshes[entries[i].item];
+            sortedInstances[i] = instances[entries[i].item];
+            entries[i].item = (uint32_t)i;
+        }
+        meshes.swap(sortedMeshes);
+        instances.swap(sortedInstances);
+    }
+
+    size_t size() const
+    {
+        return entries.size();
+    }
+
+    uint64_t key(size_t i) const
+    {
+        return entries[i].key;
+    }
+
+    const Mesh& mesh(size_t i) const
+    {
+        return *meshes[entries[i].item];
+    }
+
+    const ColoredInstance& instance(size_t i) const
+    {
+        return instances[entries[i].item];
+    }
+
+    // only valid after sort(), when payloads are in key order
+    const ColoredInstance* instanceData(size_t first) const
+    {
+        return instances.data() + first;
+    }
+
+    // number of draws from `first` on with the same program, VAO and material
+    size_t runLength(size_t first) const
+    {
+        uint64_t state = entries[first].key >> STATE_SHIFT;
+        size_t end = first + 1;
+        while (end < entries.size() && (entries[end].key >> STATE_SHIFT) == state)
+            end++;
+        return end - first;
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t key;
+        uint32_t item;   // index into meshes / instances
+    };
+
+    std::vector<Entry> entries;
+    std::vector<const Mesh*> meshes;
+    std::vector<ColoredInstance> instances;
+
+    // scratch for sort()
+    std::vector<Entry> scratch;
+    std::vector<const Mesh*> sortedMeshes;
+    std::vector<ColoredInstance> sortedInstances;
+
+    // A positive float's bit pattern orders like the float; anything at or
+    // behind the eye sorts first
+    static uint32_t depthBits(float depth)
+    {
+        if (!(depth > 0.0f))
+            return 0;
+        uint32_t bits;
+        std::memcpy(&bits, &depth, sizeof(bits));
+        return bits;
+    }
+};
+
+#endif
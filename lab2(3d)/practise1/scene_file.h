@@ -0,0 +1,409 @@
+//
+//  scene_file.h
+//  3D Object Drawing
+//
+
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <glad/glad.h>
+
+#include "geometry_pool.h"
+#include "transform_batch.h"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Binary scene file, laid out so that it can be mapped and used in place:
+//
+//   SceneFileHeader
+//   ScenePart[partCount]       culling parts: scene, group and bin, bounds
+//   SceneRecord[recordCount]   every primitive: type, transform, colour, part
+//   SceneMesh[meshCount]       the baked meshes inside the two images below
+//   vertex buffer image        vertexStride bytes per vertex
+//   index buffer image         uint16 or uint32 per mesh, 4-byte aligned
+//
+// The parts and records are the scene itself. The meshes and buffer
+// images are the records already merged and transformed, exactly as
+// GeometryPool lays them out, so a loader hands the mapped images to
+// glBufferData and only walks the records for what stays live. A file
+// without meshes is valid too: the loader then bakes the records itself,
+// which is how an edited scene is loaded before it is exported again.
+// Every section starts on an 8-byte boundary. The format is little-endian
+// and versioned; a loader rejects any other version.
+enum ScenePrimitive : uint32_t
+{
+    SCENE_CUBE = 0,
+    SCENE_CYLINDER = 1,
+    SCENE_CONE = 2
+};
+
+struct SceneFileHeader
+{
+    char magic[4];              // "SCNB"
+    uint32_t version;
+    uint32_t partCount;         // SceneRecord::part and SceneMesh::part are below this
+    uint32_t recordCount;
+    uint32_t meshCount;
+    uint32_t vertexStride;
+    uint64_t partOffset;
+    uint64_t recordOffset;
+    uint64_t meshOffset;
+    uint64_t vertexOffset;
+    uint64_t vertexBytes;
+    uint64_t indexOffset;
+    uint64_t indexBytes;
+};
+
+// A culling unit and the box around everything drawn for it. scene, group
+// and bin are the loader's own enums and binning, so a file only fits the
+// build that exported it.
+struct ScenePart
+{
+    uint32_t scene;
+    int32_t group;
+    int32_t bin;
+    float min[3];
+    float max[3];
+};
+
+struct SceneRecord
+{
+    uint32_t primitive;         // ScenePrimitive
+    int32_t part;               // subassembly, -1 for none
+    float color[4];
+    AffineMatrix transform;
+};
+
+struct SceneMesh
+{
+    int32_t part;
+    int32_t baseVertex;
+    uint32_t firstIndex;
+    uint32_t count;
+    uint32_t indexType;         // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    uint32_t vertexCount;
+
+    Mesh mesh() const
+    {
+        Mesh result;
+        result.baseVertex = baseVertex;
+        result.firstIndex = firstIndex;
+        result.count = (GLsizei)count;
+        result.indexType = indexType;
+        result.vertexCount = vertexCount;
+        return result;
+    }
+};
+
+static const char SCENE_FILE_MAGIC[4] = { 'S', 'C', 'N', 'B' };
+static const uint32_t SCENE_FILE_VERSION = 3;
+
+// Collects parts, records and baked meshes and writes them as one scene file
+class SceneWriter
+{
+public:
+    explicit SceneWriter(size_t vertexStride) : stride(vertexStride)
+    {
+    }
+
+    void addPart(uint32_t scene, int group, int bin, const glm::vec3& min, const glm::vec3& max)
+    {
+        ScenePart part;
+        part.scene = scene;
+        part.group = group;
+        part.bin = bin;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            part.min[axis] = min[axis];
+            part.max[axis] = max[axis];
+        }
+        parts.push_back(part);
+    }
+
+    void addRecord(ScenePrimitive primitive, int part, const glm::vec4& color, const glm::mat4& transform)
+    {
+        SceneRecord record;
+        record.primitive = primitive;
+        record.part = part;
+        for (int i = 0; i < 4; i++)
+            record.color[i] = color[i];
+        record.transform = AffineMatrix::fromMat4(transform);
+        records.push_back(record);
+    }
+
+    // Appends a mesh to the buffer images the way GeometryPool::add()
+    // would place it in an empty pool.
+    void addMesh(int part, const void* vertexData, size_t vertexCount, const unsigned int* indices, size_t indexCount)
+    {
+        bool shortIndices = vertexCount <= 65536;
+        size_t indexSize = shortIndices ? sizeof(uint16_t) : sizeof(uint32_t);
+        indexImage.resize((indexImage.size() + 3) / 4 * 4);
+
+        SceneMesh mesh;
+        mesh.part = part;
+        mesh.baseVertex = (int32_t)(vertexImage.size() / stride);
+        mesh.firstIndex = (uint32_t)(indexImage.size() / indexSize);
+        mesh.count = (uint32_t)indexCount;
+        mesh.indexType = shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        mesh.vertexCount = (uint32_t)vertexCount;
+        meshes.push_back(mesh);
+
+        const unsigned char* bytes = (const unsigned char*)vertexData;
+        vertexImage.insert(vertexImage.end(), bytes, bytes + vertexCount * stride);
+        for (size_t i = 0; i < indexCount; i++)
+        {
+            unsigned char value[4];
+            if (shortIndices)
+            {
+                uint16_t narrow = (uint16_t)indices[i];
+                std::memcpy(value, &narrow, sizeof(narrow));
+            }
+            else
+            {
+                std::memcpy(value, &indices[i], sizeof(uint32_t));
+            }
+            indexImage.insert(indexImage.end(), value, value + indexSize);
+        }
+    }
+
+    size_t recordCount() const
+    {
+        return records.size();
+    }
+
+    bool save(const std::string& path) const
+    {
+        SceneFileHeader header;
+        std::memcpy(header.magic, SCENE_FILE_MAGIC, sizeof(header.magic));
+        header.version = SCENE_FILE_VERSION;
+        header.partCount = (uint32_t)parts.size();
+        header.recordCount = (uint32_t)records.size();
+        header.meshCount = (uint32_t)meshes.size();
+        header.vertexStride = (uint32_t)stride;
+        header.partOffset = align(sizeof(header));
+        header.recordOffset = align(header.partOffset + parts.size() * sizeof(ScenePart));
+        header.meshOffset = align(header.recordOffset + records.size() * sizeof(SceneRecord));
+        header.vertexOffset = align(header.meshOffset + meshes.size() * sizeof(SceneMesh));
+        header.vertexBytes = vertexImage.size();
+        header.indexOffset = align(header.vertexOffset + header.vertexBytes);
+        header.indexBytes = indexImage.size();
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+        write(file, &header, sizeof(header));
+        pad(file, header.partOffset);
+        write(file, parts.data(), parts.size() * sizeof(ScenePart));
+        pad(file, header.recordOffset);
+        write(file, records.data(), records.size() * sizeof(SceneRecord));
+        pad(file, header.meshOffset);
+        write(file, meshes.data(), meshes.size() * sizeof(SceneMesh));
+        pad(file, header.vertexOffset);
+        write(file, vertexImage.data(), vertexImage.size());
+        pad(file, header.indexOffset);
+        write(file, indexImage.data(), indexImage.size());
+        return (bool)file;
+    }
+
+private:
+    size_t stride;
+    std::vector<ScenePart> parts;
+    std::vector<SceneRecord> records;
+    std::vector<SceneMesh> meshes;
+    std::vector<unsigned char> vertexImage;
+    std::vector<unsigned char> indexImage;
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + 7) / 8 * 8;
+    }
+
+    static void write(std::ofstream& file, const void* data, size_t bytes)
+    {
+        file.write((const char*)data, (std::streamsize)bytes);
+    }
+
+    static void pad(std::ofstream& file, uint64_t offset)
+    {
+        static const char zeros[8] = {};
+        uint64_t position = (uint64_t)file.tellp();
+        write(file, zeros, (size_t)(offset - position));
+    }
+};
+
+// A scene file mapped read-only into memory. Nothing is copied or parsed:
+// the accessors point into the mapping, which lives as long as the object.
+class MappedSceneFile
+{
+public:
+    MappedSceneFile() = default;
+    MappedSceneFile(const MappedSceneFile&) = delete;
+    MappedSceneFile& operator=(const MappedSceneFile&) = delete;
+
+    ~MappedSceneFile()
+    {
+        close();
+    }
+
+    // False, with the reason in error(), when the file is missing, of
+    // another version or its sections do not fit inside it.
+    bool open(const std::string& path)
+    {
+        close();
+        if (!map(path))
+        {
+            problem = "cannot map " + path;
+            return false;
+        }
+        if (size < sizeof(SceneFileHeader) || std::memcmp(header().magic, SCENE_FILE_MAGIC, sizeof(SCENE_FILE_MAGIC)) != 0)
+            return fail("not a scene file");
+        const SceneFileHeader& h = header();
+        if (h.version != SCENE_FILE_VERSION)
+            return fail("scene file version " + std::to_string(h.version) + ", expected " + std::to_string(SCENE_FILE_VERSION));
+        if (!fits(h.partOffset, (uint64_t)h.partCount * sizeof(ScenePart)) ||
+            !fits(h.recordOffset, (uint64_t)h.recordCount * sizeof(SceneRecord)) ||
+            !fits(h.meshOffset, (uint64_t)h.meshCount * sizeof(SceneMesh)) ||
+            !fits(h.vertexOffset, h.vertexBytes) || !fits(h.indexOffset, h.indexBytes) ||
+            h.partOffset % 8 || h.recordOffset % 8 || h.meshOffset % 8)
+            return fail("truncated scene file");
+        return true;
+    }
+
+    void close()
+    {
+        if (!data)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+        CloseHandle(mapping);
+        CloseHandle(fileHandle);
+#else
+        munmap(data, size);
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    bool isOpen() const
+    {
+        return data != nullptr;
+    }
+
+    const std::string& error() const
+    {
+        return problem;
+    }
+
+    const SceneFileHeader& header() const
+    {
+        return *(const SceneFileHeader*)data;
+    }
+
+    const ScenePart* parts() const
+    {
+        return (const ScenePart*)(bytes() + header().partOffset);
+    }
+
+    const SceneRecord* records() const
+    {
+        return (const SceneRecord*)(bytes() + header().recordOffset);
+    }
+
+    const SceneMesh* meshes() const
+    {
+        return (const SceneMesh*)(bytes() + header().meshOffset);
+    }
+
+    const void* vertexData() const
+    {
+        return bytes() + header().vertexOffset;
+    }
+
+    const void* indexData() const
+    {
+        return bytes() + header().indexOffset;
+    }
+
+private:
+    void* data = nullptr;
+    size_t size = 0;
+    std::string problem;
+#ifdef _WIN32
+    HANDLE fileHandle = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#endif
+
+    const unsigned char* bytes() const
+    {
+        return (const unsigned char*)data;
+    }
+
+    bool fits(uint64_t offset, uint64_t length) const
+    {
+        return offset <= size && length <= size - offset;
+    }
+
+    bool fail(const std::string& reason)
+    {
+        close();
+        problem = reason;
+        return false;
+    }
+
+    bool map(const std::string& path)
+    {
+#ifdef _WIN32
+        fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (fileHandle == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        mapping = GetFileSizeEx(fileHandle, &fileSize) && fileSize.QuadPart > 0 ?
+            CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+        data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (!data)
+        {
+            if (mapping)
+                CloseHandle(mapping);
+            CloseHandle(fileHandle);
+            return false;
+        }
+        size = (size_t)fileSize.QuadPart;
+        return true;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        void* mapped = MAP_FAILED;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+            mapped = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+            return false;
+        data = mapped;
+        size = (size_t)info.st_size;
+        return true;
+#endif
+    }
+};
+
+#endif
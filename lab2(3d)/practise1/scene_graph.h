@@ -0,0 +1,139 @@
+//
+//  scene_graph.h
+//  3D Object Drawing
+//
+
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <vector>
+#include <iostream>
+
+// Local transform of a node, composed as
+//   translate(position) * rotateX * rotateY * rotateZ * scale * translate(origin)
+// which is the chain drawCube() used to build for every draw. Rotations are
+// in degrees. origin moves the node's own geometry (e.g. to centre a mesh
+// on its pivot) and is inherited by children, so keep it on leaves.
+struct Transform
+{
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 rotation = glm::vec3(0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+    glm::vec3 origin = glm::vec3(0.0f);
+
+    glm::mat4 matrix() const
+    {
+        glm::mat4 m = glm::translate(glm::mat4(1.0f), position);
+        m = glm::rotate(m, glm::radians(rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+        m = glm::rotate(m, glm::radians(rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+        m = glm::rotate(m, glm::radians(rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+        m = glm::scale(m, scale);
+        return glm::translate(m, origin);
+    }
+};
+
+// Flat transform hierarchy. Nodes are stored in arrays indexed by node id
+// and a parent is always added before its children, so one forward pass
+// over the arrays updates the whole tree. Setters only flag a node when the
+// value actually changes; update() then recomputes the flagged nodes and
+// everything below them and leaves the rest of the world matrices alone.
+// The world matrices are contiguous, so nodes added back to back can be
+// handed to an instance buffer as one range.
+class SceneGraph
+{
+public:
+    static const int NO_PARENT = -1;
+
+    // The parent has to exist already, which is what keeps parents ahead of
+    // their children; any other parent is rejected and -1 returned.
+    int addNode(int parent, const Transform& local = Transform())
+    {
+        if (parent != NO_PARENT && (parent < 0 || parent >= (int)parents.size()))
+        {
+            std::cout << "ERROR::SCENE_GRAPH::PARENT_NOT_ADDED_YET: " << parent << std::endl;
+            return -1;
+        }
+        parents.push_back(parent);
+        locals.push_back(local);
+        worlds.push_back(glm::mat4(1.0f));
+        dirty.push_back(1);
+        return (int)parents.size() - 1;
+    }
+
+    const Transform& local(int node) const
+    {
+        return locals[node];
+    }
+
+    void setPosition(int node, const glm::vec3& position)
+    {
+        if (locals[node].position == position)
+            return;
+        locals[node].position = position;
+        dirty[node] = 1;
+    }
+
+    void setRotation(int node, const glm::vec3& rotation)
+    {
+        if (locals[node].rotation == rotation)
+            return;
+        locals[node].rotation = rotation;
+        dirty[node] = 1;
+    }
+
+    void setScale(int node, const glm::vec3& scale)
+    {
+        if (locals[node].scale == scale)
+            return;
+        locals[node].scale = scale;
+        dirty[node] = 1;
+    }
+
+    // Returns the number of world matrices that were recomputed.
+    int update()
+    {
+        int updated = 0;
+        for (size_t i = 0; i < parents.size(); i++)
+        {
+            int parent = parents[i];
+            // a parent recomputed in this pass is still flagged
+            if (parent != NO_PARENT && dirty[parent])
+                dirty[i] = 1;
+            if (!dirty[i])
+                continue;
+
+            glm::mat4 localMatrix = locals[i].matrix();
+            worlds[i] = parent == NO_PARENT ? localMatrix : worlds[parent] * localMatrix;
+            updated++;
+        }
+        for (size_t i = 0; i < dirty.size(); i++)
+            dirty[i] = 0;
+        return updated;
+    }
+
+    const glm::mat4& world(int node) const
+    {
+        return worlds[node];
+    }
+
+    const glm::mat4* worldMatrices() const
+    {
+        return worlds.data();
+    }
+
+    size_t size() const
+    {
+        return parents.size();
+    }
+
+private:
+    std::vector<int> parents;
+    std::vector<Transform> locals;
+    std::vector<glm::mat4> worlds;
+    std::vector<unsigned char> dirty;
+};
+
+#endif
@@ -11,80 +11,230 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "gl_state.h"
+#include "gl_extensions.h"
+#include "shader_preprocessor.h"
+
 #include <string>
-#include <fstream>
-#include <sstream>
+#include <vector>
 #include <iostream>
 
+// Fixed binding points of the uniform blocks shared by every program.
+// GLSL 330 has no layout(binding = N), so Shader wires them up after linking.
+const GLuint CAMERA_BLOCK_BINDING = 0;
+const GLuint LIGHT_GRID_BLOCK_BINDING = 1;
+
+struct UniformBlockBinding
+{
+    const char* name;
+    GLuint binding;
+};
+
+const UniformBlockBinding sharedUniformBlocks[] = {
+    { "Camera", CAMERA_BLOCK_BINDING },
+    { "LightGrid", LIGHT_GRID_BLOCK_BINDING },
+};
+
+// Texture units of the shared samplers, wired up the same way. They sit
+// above the units a program would use for its own textures.
+const GLint LIGHT_DATA_UNIT = 8;
+const GLint CLUSTER_RANGES_UNIT = 9;
+const GLint LIGHT_INDICES_UNIT = 10;
+
+struct SamplerBinding
+{
+    const char* name;
+    GLint unit;
+};
+
+const SamplerBinding sharedSamplers[] = {
+    { "lightData", LIGHT_DATA_UNIT },
+    { "clusterRanges", CLUSTER_RANGES_UNIT },
+    { "lightIndices", LIGHT_INDICES_UNIT },
+};
+
+// GL type each uniform handle is checked against when a program is linked.
+template <typename T> struct UniformType;
+template <> struct UniformType<bool>      { static const GLenum value = GL_BOOL; };
+template <> struct UniformType<int>       { static const GLenum value = GL_INT; };
+template <> struct UniformType<float>     { static const GLenum value = GL_FLOAT; };
+template <> struct UniformType<glm::vec2> { static const GLenum value = GL_FLOAT_VEC2; };
+template <> struct UniformType<glm::vec3> { static const GLenum value = GL_FLOAT_VEC3; };
+template <> struct UniformType<glm::vec4> { static const GLenum value = GL_FLOAT_VEC4; };
+template <> struct UniformType<glm::mat2> { static const GLenum value = GL_FLOAT_MAT2; };
+template <> struct UniformType<glm::mat3> { static const GLenum value = GL_FLOAT_MAT3; };
+template <> struct UniformType<glm::mat4> { static const GLenum value = GL_FLOAT_MAT4; };
+
+struct UniformName
+{
+    std::string name;
+    GLenum type;
+};
+
+// Process-wide list of every uniform name a handle was created for.
+inline std::vector<UniformName>& uniformNameRegistry()
+{
+    static std::vector<UniformName> registry;
+    return registry;
+}
+
+inline unsigned int internUniformName(const char* name, GLenum type)
+{
+    std::vector<UniformName>& registry = uniformNameRegistry();
+    for (unsigned int i = 0; i < registry.size(); i++)
+    {
+        if (registry[i].type == type && registry[i].name == name)
+            return i;
+    }
+    registry.push_back({ name, type });
+    return (unsigned int)registry.size() - 1;
+}
+
+// Typed, pre-resolved uniform handle. The name is interned once when the handle
+// is created; every Shader keeps a flat location table indexed by that id, so
+// one handle works with any program and a set is an array index plus glUniform*.
+template <typename T>
+struct Uniform
+{
+    unsigned int id;
+
+    explicit Uniform(const char* name) : id(internUniformName(name, UniformType<T>::value)) {}
+};
+
 class Shader
 {
 public:
-    unsigned int ID;
+    // one entry per active uniform, filled by glGetActiveUniform after linking
+    struct UniformInfo
+    {
+        std::string name;
+        GLenum type;
+        GLint size;
+        GLint location;
+    };
+
+    unsigned int ID = 0;
+    std::vector<UniformInfo> uniforms;
+
+    Shader() {}
     
-    Shader(const char* vertexPath, const char* fragmentPath)
+    // Blocking build of one variant, preprocessed the way ProgramCache
+    // does it so #include and the feature defines work here too
+    Shader(const char* vertexPath, const char* fragmentPath, unsigned int features = 0)
+    {
+        ShaderPreprocessor preprocessor;
+        std::string vertexCode = preprocessor.process(vertexPath, features);
+        std::string fragmentCode = preprocessor.process(fragmentPath, features);
+        if (vertexCode.empty() || fragmentCode.empty())
+            return;
+        compile(vertexCode, fragmentCode);
+        finish();
+    }
+
+    // Queues compilation and linking without reading any status back. With
+    // KHR_parallel_shader_compile the driver does the work on its own
+    // threads and isReady() can be polled instead of blocking in finish().
+    void compile(const std::string& vertexCode, const std::string& fragmentCode)
     {
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        
-        vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        try
-        {
-            std::cout << "Attempting to load vertex shader: " << vertexPath << std::endl;
-            vShaderFile.open(vertexPath);
-            std::cout << "Attempting to load fragment shader: " << fragmentPath << std::endl;
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            
-            vShaderFile.close();
-            fShaderFile.close();
-            
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
-            std::cout << "Shaders loaded successfully!" << std::endl;
-        }
-        catch (std::ifstream::failure& e)
-        {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
-            std::cout << "Error code: " << e.code() << std::endl;
-            std::cout << "Error message: " << e.what() << std::endl;
-            std::cout << "Vertex shader path: " << vertexPath << std::endl;
-            std::cout << "Fragment shader path: " << fragmentPath << std::endl;
-            std::cout << "Make sure shader files are in the same directory as the executable or provide full path." << std::endl;
-        }
         const char* vShaderCode = vertexCode.c_str();
         const char* fShaderCode = fragmentCode.c_str();
         
-        unsigned int vertex, fragment;
-        
         vertex = glCreateShader(GL_VERTEX_SHADER);
         glShaderSource(vertex, 1, &vShaderCode, NULL);
         glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
         
         fragment = glCreateShader(GL_FRAGMENT_SHADER);
         glShaderSource(fragment, 1, &fShaderCode, NULL);
         glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
         
         ID = glCreateProgram();
+        if (glExt().programBinary)
+            glExt().programParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
         glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+        pending = true;
+    }
+
+    // Recreates a program from a blob saved with getBinary(). Drivers reject
+    // blobs from other versions or GPUs, in which case the caller compiles.
+    bool loadBinary(GLenum format, const void* binary, GLsizei length)
+    {
+        if (!glExt().programBinary)
+            return false;
+
+        ID = glCreateProgram();
+        glExt().programBinaryLoad(ID, format, binary, length);
+        GLint success = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            glDeleteProgram(ID);
+            ID = 0;
+            return false;
+        }
+        linked = true;
+        bindUniformBlocks();
+        reflectUniforms();
+        return true;
+    }
+
+    bool getBinary(GLenum& format, std::vector<char>& binary) const
+    {
+        if (!glExt().programBinary || !linked)
+            return false;
+
+        GLint length = 0;
+        glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return false;
+        binary.resize(length);
+        glExt().getProgramBinary(ID, length, NULL, &format, binary.data());
+        return true;
+    }
+
+    // Never blocks when the driver reports completion status; without the
+    // extension the first call simply finishes the build.
+    bool isReady()
+    {
+        if (!pending)
+            return ID != 0;
+        if (glExt().parallelShaderCompile)
+        {
+            GLint done = 0;
+            glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+            if (!done)
+                return false;
+        }
+        finish();
+        return true;
+    }
+
+    void finish()
+    {
+        if (!pending)
+            return;
+        pending = false;
+
+        checkCompileErrors(vertex, "VERTEX");
+        checkCompileErrors(fragment, "FRAGMENT");
+        linked = checkCompileErrors(ID, "PROGRAM");
         
         glDeleteShader(vertex);
         glDeleteShader(fragment);
+
+        bindUniformBlocks();
+        reflectUniforms();
+    }
+
+    bool isLinked() const
+    {
+        return linked;
     }
     
     void use() const
     {
-        glUseProgram(ID);
+        glState().useProgram(ID);
     }
     
     void setBool(const std::string& name, bool value) const
@@ -144,8 +294,152 @@ public:
         glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
     }
 
+    // handle based setters: no string building and no glGetUniformLocation
+    void set(Uniform<bool> u, bool value) const
+    {
+        glUniform1i(location(u.id), (int)value);
+    }
+
+    void set(Uniform<int> u, int value) const
+    {
+        glUniform1i(location(u.id), value);
+    }
+
+    void set(Uniform<float> u, float value) const
+    {
+        glUniform1f(location(u.id), value);
+    }
+
+    void set(Uniform<glm::vec2> u, const glm::vec2& value) const
+    {
+        glUniform2fv(location(u.id), 1, &value[0]);
+    }
+
+    void set(Uniform<glm::vec3> u, const glm::vec3& value) const
+    {
+        glUniform3fv(location(u.id), 1, &value[0]);
+    }
+
+    void set(Uniform<glm::vec4> u, const glm::vec4& value) const
+    {
+        glUniform4fv(location(u.id), 1, &value[0]);
+    }
+
+    void set(Uniform<glm::mat2> u, const glm::mat2& mat) const
+    {
+        glUniformMatrix2fv(location(u.id), 1, GL_FALSE, &mat[0][0]);
+    }
+
+    void set(Uniform<glm::mat3> u, const glm::mat3& mat) const
+    {
+        glUniformMatrix3fv(location(u.id), 1, GL_FALSE, &mat[0][0]);
+    }
+
+    void set(Uniform<glm::mat4> u, const glm::mat4& mat) const
+    {
+        glUniformMatrix4fv(location(u.id), 1, GL_FALSE, &mat[0][0]);
+    }
+
+    // -1 when the program has no active uniform of that name and type,
+    // which glUniform* silently ignores
+    GLint location(unsigned int id) const
+    {
+        if (id >= uniformLocations.size())
+            resolveLocations();
+        return id < uniformLocations.size() ? uniformLocations[id] : -1;
+    }
+
 private:
-    void checkCompileErrors(GLuint shader, std::string type)
+    unsigned int vertex = 0;
+    unsigned int fragment = 0;
+    bool pending = false;
+    bool linked = false;
+
+    // indexed by interned uniform name id; grown lazily for handles created after linking
+    mutable std::vector<GLint> uniformLocations;
+
+    void bindUniformBlocks()
+    {
+        for (const UniformBlockBinding& block : sharedUniformBlocks)
+        {
+            GLuint index = glGetUniformBlockIndex(ID, block.name);
+            if (index != GL_INVALID_INDEX)
+                glUniformBlockBinding(ID, index, block.binding);
+        }
+        // Sampler units are program state that glUniform sets on the bound
+        // program. Programs link in the middle of frames, so the caller's
+        // program is put back afterwards and the state cache stays right.
+        GLint previous = -1;
+        for (const SamplerBinding& sampler : sharedSamplers)
+        {
+            GLint location = glGetUniformLocation(ID, sampler.name);
+            if (location < 0)
+                continue;
+            if (previous < 0)
+            {
+                glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+                glUseProgram(ID);
+            }
+            glUniform1i(location, sampler.unit);
+        }
+        if (previous >= 0)
+            glUseProgram((GLuint)previous);
+    }
+
+    void reflectUniforms()
+    {
+        uniforms.clear();
+        uniformLocations.clear();
+
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> nameBuffer(maxLength > 0 ? maxLength : 1);
+
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = GL_NONE;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)nameBuffer.size(), &length, &size, &type, nameBuffer.data());
+
+            // uniform block members have no location of their own
+            GLint loc = glGetUniformLocation(ID, nameBuffer.data());
+            if (loc < 0)
+                continue;
+
+            std::string name(nameBuffer.data(), length);
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+                name.erase(name.size() - 3);
+            uniforms.push_back({ name, type, size, loc });
+        }
+
+        resolveLocations();
+    }
+
+    // Extends the location table to every name interned so far
+    void resolveLocations() const
+    {
+        const std::vector<UniformName>& registry = uniformNameRegistry();
+        for (size_t n = uniformLocations.size(); n < registry.size(); n++)
+        {
+            GLint loc = -1;
+            for (const UniformInfo& info : uniforms)
+            {
+                if (info.name != registry[n].name)
+                    continue;
+                bool samplerAsInt = registry[n].type == GL_INT && info.type >= GL_SAMPLER_1D && info.type <= GL_SAMPLER_2D_SHADOW;
+                if (info.type == registry[n].type || samplerAsInt)
+                    loc = info.location;
+                else
+                    std::cout << "ERROR::SHADER::UNIFORM_TYPE_MISMATCH: " << info.name << std::endl;
+                break;
+            }
+            uniformLocations.push_back(loc);
+        }
+    }
+
+    bool checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -167,6 +461,7 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success != 0;
     }
 };
 #endif
@@ -0,0 +1,163 @@
+//
+//  shader_preprocessor.h
+//  3D Object Drawing
+//
+
+#ifndef SHADER_PREPROCESSOR_H
+#define SHADER_PREPROCESSOR_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+// Compile-time permutations. Each bit becomes a #define in every stage of
+// the program, so a branch on a feature costs nothing at run time.
+enum ShaderFeature : unsigned int
+{
+    SHADER_LIGHT_ON       = 1u << 0,
+    SHADER_CONSTANT_COLOR = 1u << 1,
+    SHADER_INSTANCED      = 1u << 2,
+    SHADER_VERTEX_COLOR   = 1u << 3,
+    SHADER_OVERDRAW       = 1u << 4,
+    SHADER_CLUSTERED      = 1u << 5,
+};
+
+const char* const shaderFeatureNames[] = {
+    "LIGHT_ON",
+    "CONSTANT_COLOR",
+    "INSTANCED",
+    "VERTEX_COLOR",
+    "OVERDRAW",
+    "CLUSTERED_LIGHTS",
+};
+
+inline std::string shaderFeatureDefines(unsigned int features)
+{
+    std::string defines;
+    for (unsigned int bit = 0; bit < sizeof(shaderFeatureNames) / sizeof(shaderFeatureNames[0]); bit++)
+    {
+        if (features & (1u << bit))
+            defines += std::string("#define ") + shaderFeatureNames[bit] + "\n";
+    }
+    return defines;
+}
+
+// Resolves #include "file" (relative to the including file, each file at
+// most once per stage) and injects the feature defines right after the
+// #version line. #line directives keep driver error messages pointing at the
+// original file: the source-string number is the index in includedFiles.
+class ShaderPreprocessor
+{
+public:
+    std::vector<std::string> includedFiles;
+
+    std::string process(const std::string& path, unsigned int features)
+    {
+        includedFiles.clear();
+        std::string body;
+        if (!expand(path, body, 0))
+            return "";
+
+        // #version has to stay the first statement of the stage
+        std::string defines = shaderFeatureDefines(features);
+        if (body.compare(0, 8, "#version") != 0)
+            return defines.empty() ? body : defines + "#line 1 0\n" + body;
+        size_t lineEnd = body.find('\n');
+        if (lineEnd == std::string::npos)
+            return body + "\n" + defines;
+        return body.substr(0, lineEnd + 1) + defines + "#line 2 0\n" + body.substr(lineEnd + 1);
+    }
+
+private:
+    static const int MAX_INCLUDE_DEPTH = 16;
+
+    static bool readFile(const std::string& path, std::string& code)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open())
+            return false;
+        std::stringstream stream;
+        stream << file.rdbuf();
+        code = stream.str();
+        if (code.size() >= 3 && (unsigned char)code[0] == 0xEF && (unsigned char)code[1] == 0xBB && (unsigned char)code[2] == 0xBF)
+            code.erase(0, 3);
+        return true;
+    }
+
+    static std::string directoryOf(const std::string& path)
+    {
+        size_t slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? "" : path.substr(0, slash + 1);
+    }
+
+    bool alreadyIncluded(const std::string& path) const
+    {
+        for (const std::string& file : includedFiles)
+        {
+            if (file == path)
+                return true;
+        }
+        return false;
+    }
+
+    bool expand(const std::string& path, std::string& out, int depth)
+    {
+        if (depth > MAX_INCLUDE_DEPTH)
+        {
+            std::cout << "ERROR::SHADER::INCLUDE_TOO_DEEP: " << path << std::endl;
+            return false;
+        }
+        if (alreadyIncluded(path))
+            return true;
+
+        std::string code;
+        if (!readFile(path, code))
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+            return false;
+        }
+        int fileIndex = (int)includedFiles.size();
+        includedFiles.push_back(path);
+
+        std::istringstream lines(code);
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(lines, line))
+        {
+            lineNumber++;
+            if (!line.empty() && line[line.size() - 1] == '\r')
+                line.erase(line.size() - 1);
+
+            size_t first = line.find_first_not_of(" \t");
+            if (first == std::string::npos || line.compare(first, 8, "#include") != 0)
+            {
+                out += line + "\n";
+                continue;
+            }
+
+            size_t open = line.find('"', first + 8);
+            size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+            if (close == std::string::npos)
+            {
+                std::cout << "ERROR::SHADER::BAD_INCLUDE: " << path << ":" << lineNumber << std::endl;
+                return false;
+            }
+            std::string includePath = directoryOf(path) + line.substr(open + 1, close - open - 1);
+            if (alreadyIncluded(includePath))
+            {
+                // a blank line keeps the numbering, so no #line is needed
+                out += "\n";
+                continue;
+            }
+            out += "#line 1 " + std::to_string(includedFiles.size()) + "\n";
+            if (!expand(includePath, out, depth + 1))
+                return false;
+            out += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,300 @@
+//
+//  transform_batch.h
+//  3D Object Drawing
+//
+
+#ifndef TRANSFORM_BATCH_H
+#define TRANSFORM_BATCH_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstddef>
+
+#if defined(__AVX__)
+#define TRANSFORM_AVX 1
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_SSE 1
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#endif
+
+// Affine transform packed as the top three rows of a 4x4 matrix, row-major:
+// m[r * 4 + c] is row r, column c, and column 3 is the translation. This is
+// what the batch kernels write, 48 bytes instead of 64.
+struct AffineMatrix
+{
+    float m[12];
+
+    glm::mat4 toMat4() const
+    {
+        glm::mat4 result(1.0f);
+        for (int r = 0; r < 3; r++)
+            for (int c = 0; c < 4; c++)
+                result[c][r] = m[r * 4 + c];
+        return result;
+    }
+
+    static AffineMatrix fromMat4(const glm::mat4& matrix)
+    {
+        AffineMatrix result;
+        for (int r = 0; r < 3; r++)
+            for (int c = 0; c < 4; c++)
+                result.m[r * 4 + c] = matrix[c][r];
+        return result;
+    }
+};
+
+// Translation, rotation and scale of many objects as structure of arrays:
+// component c of object i is position[c][i]. The rotation is either Euler
+// angles in degrees (x, y, z; w unused) or a unit quaternion (x, y, z, w).
+struct TransformArrays
+{
+    std::vector<float> position[3];
+    std::vector<float> rotation[4];
+    std::vector<float> scale[3];
+
+    size_t size() const
+    {
+        return position[0].size();
+    }
+
+    void clear()
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            position[c].clear();
+            scale[c].clear();
+        }
+        for (int c = 0; c < 4; c++)
+            rotation[c].clear();
+    }
+
+    void add(const glm::vec3& p, const glm::vec4& r, const glm::vec3& s)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            position[c].push_back(p[c]);
+            scale[c].push_back(s[c]);
+        }
+        for (int c = 0; c < 4; c++)
+            rotation[c].push_back(r[c]);
+    }
+};
+
+namespace transform_detail
+{
+    // The kernels are written once against a small lane type; Lane1 is the
+    // scalar tail, Lane4 SSE and Lane8 AVX.
+    struct Lane1
+    {
+        static const int WIDTH = 1;
+        float v;
+        static Lane1 splat(float f) { return { f }; }
+        static Lane1 load(const float* p) { return { *p }; }
+    };
+    inline Lane1 operator+(Lane1 a, Lane1 b) { return { a.v + b.v }; }
+    inline Lane1 operator-(Lane1 a, Lane1 b) { return { a.v - b.v }; }
+    inline Lane1 operator*(Lane1 a, Lane1 b) { return { a.v * b.v }; }
+    inline Lane1 roundNearest(Lane1 a) { return { (float)(int)(a.v + (a.v < 0.0f ? -0.5f : 0.5f)) }; }
+    inline Lane1 greater(Lane1 a, Lane1 b) { return { a.v > b.v ? 1.0f : 0.0f }; }
+    inline Lane1 select(Lane1 mask, Lane1 a, Lane1 b) { return mask.v != 0.0f ? a : b; }
+    inline void storeAffine(const Lane1* m, AffineMatrix* out)
+    {
+        for (int i = 0; i < 12; i++)
+            out->m[i] = m[i].v;
+    }
+
+#ifdef TRANSFORM_SSE
+    struct Lane4
+    {
+        static const int WIDTH = 4;
+        __m128 v;
+        static Lane4 splat(float f) { return { _mm_set1_ps(f) }; }
+        static Lane4 load(const float* p) { return { _mm_loadu_ps(p) }; }
+    };
+    inline Lane4 operator+(Lane4 a, Lane4 b) { return { _mm_add_ps(a.v, b.v) }; }
+    inline Lane4 operator-(Lane4 a, Lane4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+    inline Lane4 operator*(Lane4 a, Lane4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+    inline Lane4 roundNearest(Lane4 a) { return { _mm_cvtepi32_ps(_mm_cvtps_epi32(a.v)) }; }
+    inline Lane4 greater(Lane4 a, Lane4 b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+    inline Lane4 select(Lane4 mask, Lane4 a, Lane4 b)
+    {
+        return { _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)) };
+    }
+
+    // four lanes of the same row element become one row of four matrices
+    inline void storeRows(__m128 a, __m128 b, __m128 c, __m128 d, int row, AffineMatrix* out)
+    {
+        _MM_TRANSPOSE4_PS(a, b, c, d);
+        _mm_storeu_ps(out[0].m + row * 4, a);
+        _mm_storeu_ps(out[1].m + row * 4, b);
+        _mm_storeu_ps(out[2].m + row * 4, c);
+        _mm_storeu_ps(out[3].m + row * 4, d);
+    }
+
+    inline void storeAffine(const Lane4* m, AffineMatrix* out)
+    {
+        for (int row = 0; row < 3; row++)
+            storeRows(m[row * 4].v, m[row * 4 + 1].v, m[row * 4 + 2].v, m[row * 4 + 3].v, row, out);
+    }
+#endif
+
+#ifdef TRANSFORM_AVX
+    struct Lane8
+    {
+        static const int WIDTH = 8;
+        __m256 v;
+        static Lane8 splat(float f) { return { _mm256_set1_ps(f) }; }
+        static Lane8 load(const float* p) { return { _mm256_loadu_ps(p) }; }
+    };
+    inline Lane8 operator+(Lane8 a, Lane8 b) { return { _mm256_add_ps(a.v, b.v) }; }
+    inline Lane8 operator-(Lane8 a, Lane8 b) { return { _mm256_sub_ps(a.v, b.v) }; }
+    inline Lane8 operator*(Lane8 a, Lane8 b) { return { _mm256_mul_ps(a.v, b.v) }; }
+    inline Lane8 roundNearest(Lane8 a) { return { _mm256_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC) }; }
+    inline Lane8 greater(Lane8 a, Lane8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+    inline Lane8 select(Lane8 mask, Lane8 a, Lane8 b) { return { _mm256_blendv_ps(b.v, a.v, mask.v) }; }
+
+    inline void storeAffine(const Lane8* m, AffineMatrix* out)
+    {
+        for (int row = 0; row < 3; row++)
+        {
+            const Lane8* r = m + row * 4;
+            storeRows(_mm256_castps256_ps128(r[0].v), _mm256_castps256_ps128(r[1].v),
+                _mm256_castps256_ps128(r[2].v), _mm256_castps256_ps128(r[3].v), row, out);
+            storeRows(_mm256_extractf128_ps(r[0].v, 1), _mm256_extractf128_ps(r[1].v, 1),
+                _mm256_extractf128_ps(r[2].v, 1), _mm256_extractf128_ps(r[3].v, 1), row, out + 4);
+        }
+    }
+#endif
+
+    // sin(x) for any x: reduced to [-pi, pi], folded onto [-pi/2, pi/2]
+    // and evaluated as a degree 11 Taylor polynomial, within 1e-7 there
+    template <class V>
+    inline V sinLanes(V x)
+    {
+        const V pi = V::splat(3.14159265f), halfPi = V::splat(1.57079633f);
+        x = x - V::splat(6.28318531f) * roundNearest(x * V::splat(0.159154943f));
+        x = select(greater(x, halfPi), pi - x, x);
+        x = select(greater(V::splat(0.0f) - halfPi, x), V::splat(0.0f) - pi - x, x);
+        V x2 = x * x;
+        V p = V::splat(-2.50521084e-8f);
+        p = p * x2 + V::splat(2.75573192e-6f);
+        p = p * x2 + V::splat(-1.98412698e-4f);
+        p = p * x2 + V::splat(8.33333333e-3f);
+        p = p * x2 + V::splat(-1.66666667e-1f);
+        return x + x * x2 * p;
+    }
+
+    // Rotation rows r[row * 3 + column] of WIDTH objects starting at i
+    template <class V>
+    inline void eulerRotation(const TransformArrays& in, size_t i, V* r)
+    {
+        const V toRadians = V::splat(0.0174532925f), quarterTurn = V::splat(1.57079633f);
+        V s[3], c[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            V angle = V::load(in.rotation[axis].data() + i) * toRadians;
+            s[axis] = sinLanes(angle);
+            c[axis] = sinLanes(angle + quarterTurn);
+        }
+        // rotateX * rotateY * rotateZ, the order Transform::matrix() uses
+        r[0] = c[1] * c[2];
+        r[1] = V::splat(0.0f) - c[1] * s[2];
+        r[2] = s[1];
+        r[3] = s[0] * s[1] * c[2] + c[0] * s[2];
+        r[4] = c[0] * c[2] - s[0] * s[1] * s[2];
+        r[5] = V::splat(0.0f) - s[0] * c[1];
+        r[6] = s[0] * s[2] - c[0] * s[1] * c[2];
+        r[7] = c[0] * s[1] * s[2] + s[0] * c[2];
+        r[8] = c[0] * c[1];
+    }
+
+    template <class V>
+    inline void quaternionRotation(const TransformArrays& in, size_t i, V* r)
+    {
+        V x = V::load(in.rotation[0].data() + i), y = V::load(in.rotation[1].data() + i);
+        V z = V::load(in.rotation[2].data() + i), w = V::load(in.rotation[3].data() + i);
+        const V one = V::splat(1.0f), two = V::splat(2.0f);
+        r[0] = one - two * (y * y + z * z);
+        r[1] = two * (x * y - w * z);
+        r[2] = two * (x * z + w * y);
+        r[3] = two * (x * y + w * z);
+        r[4] = one - two * (x * x + z * z);
+        r[5] = two * (y * z - w * x);
+        r[6] = two * (x * z - w * y);
+        r[7] = two * (y * z + w * x);
+        r[8] = one - two * (x * x + y * y);
+    }
+
+    // translate(position) * rotation * scale, then parent * that
+    template <class V, bool QUATERNION>
+    inline void composeLanes(const TransformArrays& in, size_t i, const AffineMatrix* parent, AffineMatrix* out)
+    {
+        V r[9];
+        if (QUATERNION)
+            quaternionRotation(in, i, r);
+        else
+            eulerRotation(in, i, r);
+
+        V local[12];
+        for (int row = 0; row < 3; row++)
+        {
+            for (int column = 0; column < 3; column++)
+                local[row * 4 + column] = r[row * 3 + column] * V::load(in.scale[column].data() + i);
+            local[row * 4 + 3] = V::load(in.position[row].data() + i);
+        }
+        if (!parent)
+        {
+            storeAffine(local, out + i);
+            return;
+        }
+
+        V world[12];
+        for (int row = 0; row < 3; row++)
+        {
+            V p0 = V::splat(parent->m[row * 4]), p1 = V::splat(parent->m[row * 4 + 1]);
+            V p2 = V::splat(parent->m[row * 4 + 2]);
+            for (int column = 0; column < 4; column++)
+                world[row * 4 + column] = p0 * local[column] + p1 * local[4 + column] + p2 * local[8 + column];
+            world[row * 4 + 3] = world[row * 4 + 3] + V::splat(parent->m[row * 4 + 3]);
+        }
+        storeAffine(world, out + i);
+    }
+
+    template <bool QUATERNION>
+    inline void compose(const TransformArrays& in, AffineMatrix* out, const AffineMatrix* parent)
+    {
+        size_t count = in.size(), i = 0;
+#if defined(TRANSFORM_AVX)
+        for (; i + 8 <= count; i += 8)
+            composeLanes<Lane8, QUATERNION>(in, i, parent, out);
+#endif
+#if defined(TRANSFORM_SSE)
+        for (; i + 4 <= count; i += 4)
+            composeLanes<Lane4, QUATERNION>(in, i, parent, out);
+#endif
+        for (; i < count; i++)
+            composeLanes<Lane1, QUATERNION>(in, i, parent, out);
+    }
+}
+
+// Composes out[i] = parent * translate(position) * rotation * scale for
+// every object in one pass, eight at a time with AVX, four with SSE and the
+// rest one by one. The Euler order matches Transform::matrix() (x, then y,
+// then z, applied to the object last to first); the sine and cosine are
+// polynomial, within a few 1e-7 of the library's. parent may be null.
+// `out` needs room for in.size() matrices.
+inline void composeEulerTransforms(const TransformArrays& in, AffineMatrix* out, const AffineMatrix* parent = nullptr)
+{
+    transform_detail::compose<false>(in, out, parent);
+}
+
+inline void composeQuaternionTransforms(const TransformArrays& in, AffineMatrix* out, const AffineMatrix* parent = nullptr)
+{
+    transform_detail::compose<true>(in, out, parent);
+}
+
+#endif
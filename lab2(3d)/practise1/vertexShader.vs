@@ -1,15 +1,23 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aColor;
+#ifdef INSTANCED
+layout (location = 2) in mat4 aModel;
+#endif
 
 out vec4 color;
 
+#include "camera.glsl"
+
+#ifndef INSTANCED
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#endif
 
 void main()
 {
+#ifdef INSTANCED
+    mat4 model = aModel;
+#endif
     gl_Position = projection * view * model * vec4(aPos, 1.0f);
     color = vec4(aColor, 1.0f);
 }